@@ -1,6 +1,11 @@
 #include "classes.h"
 #include "otp_base.h"
 #include "configuration.h"
+#include "xor_kernel.h"
+#include "otp_image_generator.h"
+#include "retransmit_link.h"
+
+#include <ctime>
 
 static AESPackage g_test_pkg;
 
@@ -8,7 +13,10 @@ static AESPackage g_test_pkg;
 int test_OTP(u32 nMessages, 
              u32 otp_size_mb, 
              u32 nMessageSize,
-             NotificationsMgrBase* pNotifier)
+             NotificationsMgrBase* pNotifier,
+             u32 dropPermille,
+             u32 fecGroup,
+             bool redundant)
 {
     int ret = 0;
     u8* rnd_content = NULL;
@@ -16,7 +24,8 @@ int test_OTP(u32 nMessages,
         printf("Creating OTP image file %s, size %d Mb ...\n", GV_OtpImagePath.c_str(), otp_size_mb);
         //GV_OtpImagePath = OTP_POSITIONING_FILENAME;
 
-        OTP_Processor::createImage(GV_OtpImagePath, otp_size_mb);
+        OtpImageGenerator generator(GV_OtpImagePath, otp_size_mb, pNotifier);
+        generator.generate();
         File tmp_img;
         tmp_img.open(GV_OtpImagePath,"rb");
         tmp_img.close();
@@ -52,10 +61,23 @@ int test_OTP(u32 nMessages,
         aes.attach( &otp, true );
         aes.attach( &otp, false );
         otp.attach( &aes, true );
-        otp.attach( ssl.getSSLTunnel(), false );
 
-        //ssl.getSSLTunnel()->attach( &otp, true );
-        ssl.getSSLTunnel()->attach( &otp, false );
+        /*  lost clusters are recovered by the selective retransmit */
+        auto_ptr<RetransmitLink> link;
+        if( dropPermille || redundant ) {
+            link.reset( new RetransmitLink(&otp, ssl.getSSLTunnel(), pNotifier) );
+            link->setDropRate( dropPermille );
+            link->setFecGroup( fecGroup );
+            link->setRedundant( redundant );
+            link->setChannelScheduling( ssl.getSSLTunnel() );
+            otp.attach( link.get(), false );
+            ssl.getSSLTunnel()->attach( link.get(), false );
+        }
+        else {
+            otp.attach( ssl.getSSLTunnel(), false );
+            //ssl.getSSLTunnel()->attach( &otp, true );
+            ssl.getSSLTunnel()->attach( &otp, false );
+        }
         printf("OK\n");
 
         printf("Starting threads ...\n");
@@ -83,6 +105,23 @@ int test_OTP(u32 nMessages,
         {
             MGuard g(consoleLock);
             printf("\rOK\n");
+            if( link.get() )
+                printf("Dropped %llu clusters, rebuilt %llu, NACKs %llu, retransmitted %llu, duplicates %llu\n",
+                       (unsigned long long)link->getDropped(),
+                       (unsigned long long)link->getRebuilt(),
+                       (unsigned long long)link->getNacksSent(),
+                       (unsigned long long)link->getRetransmitted(),
+                       (unsigned long long)link->getDuplicates());
+            if( link.get() && dropPermille )
+            {
+                /*  the drops must be recovered by the mode under test, not by the gap expiration */
+                u64 recovered = redundant ? link->getDuplicates() :
+                    (fecGroup ? link->getRebuilt() : link->getRetransmitted());
+                if( recovered == 0 ) {
+                    printf("No clusters are recovered with %u permille dropped\n", dropPermille);
+                    ret = -1;
+                }
+            }
             printf("Shutting down ...\n");
         }
 
@@ -126,3 +165,76 @@ int test_OTP(u32 nMessages,
 
     return ret;
 }
+
+/***********************************************************/
+/*  Kernel output at the tails and unaligned addresses, dst is equal to src too */
+static bool checkXorKernel( XorKernel::Func func )
+{
+    const u32 lengths[] = { 1, 15, 17, 31, 33, 63, 65, CLUSTER_DATALEN - 1, CLUSTER_DATALEN };
+    std::vector<u8> data(CLUSTER_DATALEN + 1), pad(CLUSTER_DATALEN + 1), out(CLUSTER_DATALEN + 2);
+    for( u32 i = 0; i < data.size(); ++i ) {
+        data[i] = (u8)rand();
+        pad[i] = (u8)rand();
+    }
+
+    for( u32 i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i )
+    {
+        u32 len = lengths[i];
+        for( u32 offset = 0; offset < 2; ++offset )
+        {
+            /*  the byte after output should be left */
+            out[offset + len] = 0x5A;
+            func( &out[offset], &data[offset], &pad[1 - offset], len );
+            for( u32 k = 0; k < len; ++k )
+                if( out[offset + k] != (u8)(data[offset + k] ^ pad[1 - offset + k]) )
+                    return false;
+            if( out[offset + len] != 0x5A )
+                return false;
+
+            func( &out[offset], &out[offset], &pad[1 - offset], len );
+            for( u32 k = 0; k < len; ++k )
+                if( out[offset + k] != data[offset + k] )
+                    return false;
+        }
+    }
+    return true;
+}
+
+int bench_XorKernels(u32 mb_total)
+{
+    const u32 len = CLUSTER_DATALEN;
+    const u32 iterations = (u32)(((u64)mb_total << 20) / len);
+
+    std::vector<u8> data(len), pad(len), expected(len), out(len);
+    for( u32 i = 0; i < len; ++i ) {
+        data[i] = (u8)rand();
+        pad[i] = (u8)rand();
+        expected[i] = data[i] ^ pad[i];
+    }
+
+    printf("Detected kernel: %s\n", XorKernel::name( XorKernel::detect() ));
+    for( i32 type = XorKernel::Scalar; type < XorKernel::TypesNum; ++type )
+    {
+        XorKernel::Func func = XorKernel::get( (XorKernel::Type)type );
+        if( func == NULL ) {
+            printf("%-8s: not supported\n", XorKernel::name((XorKernel::Type)type));
+            continue;
+        }
+
+        func( &out[0], &data[0], &pad[0], len );
+        if( out != expected || !checkXorKernel(func) ) {
+            printf("%-8s: output differs from scalar kernel\n", XorKernel::name((XorKernel::Type)type));
+            return -1;
+        }
+
+        clock_t started = clock();
+        for( u32 i = 0; i < iterations; ++i )
+            func( &out[0], &out[0], &pad[0], len );
+        double secs = (double)(clock() - started) / CLOCKS_PER_SEC;
+
+        printf("%-8s: %u Mb in %.3f sec, %.1f Mb/sec\n", 
+            XorKernel::name((XorKernel::Type)type), mb_total, secs, 
+            secs > 0 ? mb_total / secs : 0.0);
+    }
+    return 0;
+}
@@ -20,7 +20,8 @@ void progress(bool start = false);
 class NotificationsMgrBase;
 
 int test_EnqueBufferSender(u32 nMessages, u32 kbBufferSize, u32 nMessageSize, NotificationsMgrBase* pNotifier);
-int test_OTP(u32 nMessages, u32 otp_size_mb, u32 nMessageSize, NotificationsMgrBase* pNotifier);
+int test_OTP(u32 nMessages, u32 otp_size_mb, u32 nMessageSize, NotificationsMgrBase* pNotifier, u32 dropPermille = 0, u32 fecGroup = 0, bool redundant = false);
+int bench_XorKernels(u32 mb_total);
 
 
 
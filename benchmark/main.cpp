@@ -73,5 +73,60 @@ int main()
     fflush(stdout);
     if( ret ) return ret;
 
+    printf("******************************************************************\n");
+    printf("4a. Test OTP & SSL modules with dropped clusters\n");
+    printf("__________________________________________________________________\n");
+    printf("Options: 1%% of outgoing clusters are dropped, NACK retransmit recovers them\n");
+    printf("Iterations  : 1 000 packages\n");
+    printf("OTP image   : 10 Mb\n");
+    printf("Package size: 50 Kb\n");
+    printf("__________________________________________________________________\n");
+
+    ret = test_OTP(1000, 10, 50000, &notifier, 10);
+    printf( (ret == 0) ? "\t\t\tPASS!\n\n" : "\t\t\tFAIL!\n\n" );
+    fflush(stdout);
+    if( ret ) return ret;
+
+    printf("******************************************************************\n");
+    printf("4b. Test OTP & SSL modules with dropped clusters and FEC\n");
+    printf("__________________________________________________________________\n");
+    printf("Options: 1%% of outgoing clusters are dropped, parity of 4 clusters rebuilds them\n");
+    printf("Iterations  : 1 000 packages\n");
+    printf("OTP image   : 10 Mb\n");
+    printf("Package size: 50 Kb\n");
+    printf("__________________________________________________________________\n");
+
+    ret = test_OTP(1000, 10, 50000, &notifier, 10, 4);
+    printf( (ret == 0) ? "\t\t\tPASS!\n\n" : "\t\t\tFAIL!\n\n" );
+    fflush(stdout);
+    if( ret ) return ret;
+
+    printf("******************************************************************\n");
+    printf("4c. Test OTP & SSL modules with dropped clusters and redundant send\n");
+    printf("__________________________________________________________________\n");
+    printf("Options: 1%% of cluster copies are dropped, every cluster is sent over both channels\n");
+    printf("Iterations  : 1 000 packages\n");
+    printf("OTP image   : 10 Mb\n");
+    printf("Package size: 50 Kb\n");
+    printf("__________________________________________________________________\n");
+
+    ret = test_OTP(1000, 10, 50000, &notifier, 10, 0, true);
+    printf( (ret == 0) ? "\t\t\tPASS!\n\n" : "\t\t\tFAIL!\n\n" );
+    fflush(stdout);
+    if( ret ) return ret;
+
+    printf("******************************************************************\n");
+    printf("5. OTP pad XOR kernels throughput\n");
+    printf("__________________________________________________________________\n");
+    printf("Options: each kernel is verified against scalar one, tails and unaligned addresses too\n");
+    printf("Cluster size: 4096 bytes\n");
+    printf("Data amount : 4096 Mb per kernel\n");
+    printf("__________________________________________________________________\n");
+
+    ret = bench_XorKernels(4096);
+    printf( (ret == 0) ? "\t\t\tPASS!\n\n" : "\t\t\tFAIL!\n\n" );
+    fflush(stdout);
+    if( ret ) return ret;
+
     return 0;
 }
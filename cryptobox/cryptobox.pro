@@ -38,6 +38,7 @@ SOURCES += \
     src/aes_key_exchange.cpp \
     src/aes_package.cpp \
     src/arp_package.cpp \
+    src/channel_scheduler.cpp \
     src/configuration.cpp \
     src/cryptobox.cpp \
     src/enque_buffer_sender.cpp \
@@ -48,10 +49,17 @@ SOURCES += \
     src/ip_package.cpp \
     src/ip6_package.cpp \
     src/otp_base.cpp \
+    src/otp_image_generator.cpp \
     src/otp_package.cpp \
+    src/packet_pool.cpp \
+    src/page_coalescer.cpp \
     src/raw_message.cpp \
+    src/retransmit_link.cpp \
+    src/ring_fifo_buffer.cpp \
     src/ssl_tunnel.cpp \
     src/statistics.cpp \
     src/tcp_connection.cpp \
+    src/timing_wheel.cpp \
     src/tunconnection.cpp \
-    src/tundevice.cpp
+    src/tundevice.cpp \
+    src/xor_kernel.cpp
@@ -347,12 +347,12 @@ extern u32 GV_AesOutKeyStorageSize;
 
 inline void AES_KeyExchange::getOtpInBuffersUsage( i32* bytes, i32* limit ) const {
     *bytes = getInBufferUsage();
-    *limit = (GV_AesInBufferSize << 10);
+    *limit = ((i64)GV_AesInBufferSize << 10) > MAX_I32_USAGE ? MAX_I32_USAGE : (i32)(GV_AesInBufferSize << 10);
 }
 
 inline void AES_KeyExchange::getAesOutBuffersUsage( i32* bytes, i32* limit ) const {
     *bytes = getOutBufferUsage();
-    *limit = (GV_AesOutBufferSize << 10);
+    *limit = ((i64)GV_AesOutBufferSize << 10) > MAX_I32_USAGE ? MAX_I32_USAGE : (i32)(GV_AesOutBufferSize << 10);
 }
 
 inline void AES_KeyExchange::getInkeyQueueUsage( i32* bytes, i32* limit ) const {
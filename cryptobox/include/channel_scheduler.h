@@ -0,0 +1,93 @@
+#ifndef __channel_scheduler_h__
+#define __channel_scheduler_h__
+
+#include "common_defines.h"
+#include "otp_package.h"
+#include "mutex.h"
+
+#include <vector>
+
+/*******************************************************/
+#define DEF_CHANNEL_SAMPLE_INTERVAL     2000    /* [us] socket state sampling period */
+#define DEF_CHANNEL_RTT                 1000    /* [us] RTT of channel without TCP info */
+#define DEF_CHANNEL_WINDOW              0x4000  /* [bytes] congestion window without TCP info */
+
+/*******************************************************/
+/*  Socket state of SSL channel */
+struct ChannelMetrics {
+    ChannelMetrics()
+        : rtt(0), rttVar(0), window(0), queued(0)
+    {}
+
+    u32 rtt;        /* [us] smoothed RTT */
+    u32 rttVar;     /* [us] */
+    u32 window;     /* [bytes] congestion window (cwnd * mss) */
+    u32 queued;     /* [bytes] not acknowledged data of socket send queue */
+};
+
+/*******************************************************/
+/*  Assigns clusters to SSL channel with the lowest expected delivery time:
+        rtt / 2 + (queued + size) / window * rtt
+    The socket state is sampled once per sample interval, the clusters scheduled
+    between samples are added to the sampled queue, so the burst is spread
+    by the channels capacity, and degraded channel gets less load as its
+    queue and RTT grow instead of the half of traffic.
+    All times are in microseconds of TimingWheel::monotonicUs().
+*/
+class ChannelScheduler
+{
+public:
+    explicit ChannelScheduler( u32 sampleInterval = DEF_CHANNEL_SAMPLE_INTERVAL );
+
+    /*  Reads TCP_INFO and send queue of socket
+        @returns false if the metrics aren't available (platform or socket error)
+    */
+    static bool sample( SD fd, ChannelMetrics* metrics );
+
+    /*  Claims the sample of channels if it's due, the concurrent callers
+        don't repeat it till the next sample interval
+        @returns true if the caller should sample channels (see update)
+    */
+    bool claimSample( u64 now );
+
+    /*  Sets the sampled state of channel
+        @param channel send method of channel (see Cluster::channelMethod)
+        @param metrics NULL - channel is down
+    */
+    void update( Cluster::SendMethod channel, const ChannelMetrics* metrics );
+
+    /*  Selects channel for cluster and accounts its size in the channel queue
+        @returns send method of channel, Undefined if no channel was sampled
+    */
+    Cluster::SendMethod select( u32 size );
+
+    /*  Expected delivery time of cluster in us */
+    u64 getExpectedDelivery( Cluster::SendMethod channel, u32 size ) const;
+
+private:
+    struct Channel {
+        Channel()
+            : up(false)
+        {}
+
+        ChannelMetrics metrics;
+        bool up;
+    };
+
+    inline static u32 index( Cluster::SendMethod channel )
+    {
+        i32 index = Cluster::channelIndex( channel );
+        assert( (index >= 0) && "ChannelScheduler::index Invalid channel!" );
+        return (u32)index;
+    }
+
+    u64 expectedDelivery( const Channel& channel, u32 size ) const;
+
+    mutable Mutex lock_;
+    std::vector<Channel> channels_;
+    u64 sampleInterval_;
+    u64 sampledAt_;     /* time of the last claimed sample */
+};
+
+/**/
+#endif /* __channel_scheduler_h__ */
@@ -0,0 +1,100 @@
+#ifndef __duplicate_filter_h__
+#define __duplicate_filter_h__
+
+#include "common_defines.h"
+
+#include <vector>
+
+#define DEF_DUPLICATE_WINDOW    0x10000     /* ids: 512 image clusters by 128 network cluster ids */
+
+/*******************************************************/
+/*  Sliding window bitmap of seen cluster ids. The window ends at the newest id,
+    the forward jump out of the window (peer repositioning) restarts it.
+    Ids behind the window are stale and rejected, so the late copy can't
+    wipe the window; the owner resets the filter on image rewind.
+    Used for the first-arrival dedup of clusters sent over both channels.
+*/
+class DuplicateFilter
+{
+public:
+    /*  @param window number of ids (rounded up to power of two, 64 at least) */
+    explicit DuplicateFilter( u32 window = DEF_DUPLICATE_WINDOW );
+
+    /*  Marks id as seen
+        @returns false if id was seen already or it's behind the window
+    */
+    inline bool check( u64 id );
+
+    /*  @returns distance from the newest id back to id, 0 for the newer ids */
+    inline u64 behind( u64 id ) const
+    { return (top_ && id < top_) ? top_ - 1 - id : 0; }
+
+    inline void reset( void )
+    { top_ = 0; }
+
+private:
+    inline bool testAndSet( u64 id );
+    inline void clear( u64 from, u64 to );
+
+    std::vector<u64> bits_;
+    u64 mask_;
+    u64 top_;       /* next id after the newest one, 0 - empty */
+};
+
+/*******************************************************/
+inline DuplicateFilter::DuplicateFilter( u32 window )
+    : mask_(0),
+    top_(0)
+{
+    u64 size = 64;
+    while( size < window )
+        size <<= 1;
+    mask_ = size - 1;
+    bits_.resize( (size_t)(size >> 6), 0 );
+}
+
+inline bool DuplicateFilter::testAndSet( u64 id )
+{
+    u64 bit = id & mask_;
+    u64& word = bits_[(size_t)(bit >> 6)];
+    u64 flag = (u64)1 << (bit & 63);
+    if( word & flag )
+        return false;
+    word |= flag;
+    return true;
+}
+
+inline void DuplicateFilter::clear( u64 from, u64 to )
+{
+    for( ; from < to && (from & 63); ++from )
+        bits_[(size_t)((from & mask_) >> 6)] &= ~((u64)1 << (from & 63));
+    for( ; from + 64 <= to; from += 64 )
+        bits_[(size_t)((from & mask_) >> 6)] = 0;
+    for( ; from < to; ++from )
+        bits_[(size_t)((from & mask_) >> 6)] &= ~((u64)1 << (from & 63));
+}
+
+inline bool DuplicateFilter::check( u64 id )
+{
+    if( id < top_ && top_ - id > mask_ )
+        return false;       /* stale id, its slot belongs to the newer one */
+
+    if( top_ == 0 || (id >= top_ && id - top_ >= mask_) )
+    {
+        /*  first id or repositioning, the window starts from id */
+        for( size_t i = 0; i < bits_.size(); ++i )
+            bits_[i] = 0;
+        top_ = id + 1;
+        return testAndSet( id );
+    }
+
+    if( id >= top_ ) {
+        /*  slots of the new ids were used by ids out of the window */
+        clear( top_, id + 1 );
+        top_ = id + 1;
+    }
+    return testAndSet( id );
+}
+
+/**/
+#endif /* __duplicate_filter_h__ */
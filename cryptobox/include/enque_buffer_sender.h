@@ -5,11 +5,18 @@
 #include "mutex.h"
 #include "eventp.h"
 #include "raw_message.h"
+#include "spsc_ring.h"
 
 #include <map>
 #include <memory>
 
 #define DEF_BUFFER_BLOCK_SIZE 0x1000 /* 64Kb */
+#define DEF_RING_BUFFER_SLOTS 0x1000 /* messages number in SPSC ring mode */
+#define RING_CONSUMER_SPIN    0x100  /* consumer polls before sleeping on event */
+#define RING_CONSUMER_BATCH   64     /* max messages drained by one do_perform_batch call */
+#define DEF_LOW_WATERMARK     75     /* percents of buffer size when blocked producers are released */
+#define MAX_I32_USAGE         0x7FFFFFFF
+#define MAX_SSL_CHANNELS      16     /* SSL channels per tunnel */
 
 
 class EnqueBufferSender;
@@ -31,15 +38,48 @@ public:
         SSLChannelTwo  = 2,
         Gateway_Module = 3,
         AES_Module     = 4,
-        OTP_Module     = 5
+        OTP_Module     = 5,
+        SSLChannelN    = 0x10   /* the third and next channels: SSLChannelN + index - 2 */
     };
 
+    /*  @param index zero-based index of SSL channel
+        @returns sender type of SSL channel
+    */
+    inline static SenderType channelType( u32 index )
+    {
+        assert( (index < MAX_SSL_CHANNELS) && "Communicator::channelType Invalid channel index!" );
+        return (index < 2) ? (SenderType)(SSLChannelOne + index) : (SenderType)(SSLChannelN + index - 2);
+    }
+
+    /*  @returns zero-based index of SSL channel, -1 if type isn't SSL channel */
+    inline static i32 channelIndex( SenderType type )
+    {
+        if( type == SSLChannelOne || type == SSLChannelTwo )
+            return (i32)type - SSLChannelOne;
+        if( type >= SSLChannelN && type < SSLChannelN + MAX_SSL_CHANNELS - 2 )
+            return (i32)type - SSLChannelN + 2;
+        return -1;
+    }
+
 public:
     /*  Implementation should catches all exceptions and reports about
         @returns number of processed bytes, this number used to queue clearing
     */
     virtual u32 do_perform(const RawMessage& msg, SenderType type) = 0;
 
+    /*  Batch entry point used by buffers when several messages are already queued.
+        Messages are placed contiguously in memory and should be performed in the given order.
+        Default implementation performs messages one by one through do_perform.
+        @returns number of processed bytes, this number used to queue clearing
+    */
+    virtual u32 do_perform_batch(const RawMessage* msgs, u32 count, SenderType type)
+    {
+        u32 processed = 0;
+        for( u32 i = 0; i < count; ++i )
+            processed += do_perform( msgs[i], type );
+        return processed;
+    }
+
     /*  Implementation should provides the retreiving own sender type */
     virtual SenderType get_type( void ) = 0;
 };
@@ -53,40 +93,54 @@ public:
     virtual ~FifoBuffer();
 
     /*  Starts the buffer controlling thread */
-    void start( void );
+    virtual void start( void );
 
     /*  Shutdowns the controlling thread */
-    void shutdown( void );
+    virtual void shutdown( void );
 
     /*  Sync buffer processing and performs the messages flushing
         @note call perform() to restore messages processing after compete()
     */
-    void complete( void );
+    virtual void complete( void );
 
     /*  Pauses or restores buffers processing after complete() calling */
-    void perform( bool processing );
+    virtual void perform( bool processing );
 
     /*  Returns buffer state */
-    inline bool isBufferReady( void ) const;
+    virtual inline bool isBufferReady( void ) const;
 
     /*  Pushes data to queue
         @throws Exception when thread stopped, goes to stopping or not running yet
     */
-    void enqueue( const RawMessage& msg );
+    virtual void enqueue( const RawMessage& msg );
 
     /*  Waiting for free space in case when buffer is full
         @param  nBytes orders the number of bytes that we want to write
         @returns false when thread stopped, goes to stopping or not running yet
     */
-    bool waitReadyToWrite( u32 nBytes );
+    virtual bool waitReadyToWrite( u32 nBytes );
 
     /*  Setup the buffer size   */
-    void setBufferSize(u32 kb);
+    virtual void setBufferSize(u32 kb);
 
-    /*  Statistics for buffer usage */
+    /*  Setup the low watermark. Producer blocked on the full buffer 
+        is released when usage drops below it, not on every dequeue.
+        @param percent of buffer size (1-100)
+        @note ignored by the locked queue, it releases producers on every dequeue;
+        the watermark works only after setInRingMode/setOutRingMode
+    */
+    virtual void setLowWatermark(u32 /*percent*/)
+    {}
+
+    /*  Statistics for buffer usage, read without locking */
     inline u32 getMessagesProcessed( void ) const;
+    inline i64 getBufferUsage64( void ) const;
+    inline void setBufferUsage( i64 bytes );
+    inline i64 getBufferSize( void ) const
+    { return bufferSize_; }
+
+    /*  Buffer usage truncated to 2Gb for 32-bit statistics */
     inline i32 getBufferUsage( void ) const;
-    inline void setBufferUsage( i32 bytes );
 
 protected:
     /* Thread::run implementation */
@@ -109,6 +163,7 @@ private:
 
     EnqueBufferSender* owner_;
 
+protected:
     i64 bufferSize_;
     u32 orderToWrite_;
 
@@ -116,10 +171,113 @@ private:
     volatile u32 messagesProcessed_;
 };
 
+/***************************************************************************/
+/*  Async buffer working over bounded lock-free ring.
+    Used at the stage boundaries Gateway-AES-OTP-SSL with one consumer thread:
+    dequeue doesn't take mutex and the consumer is woken up only if it was
+    sleeping on empty ring. Producers are serialized by produceLock_, so the
+    buffer fed by several threads (OTP incoming of SSL channels) keeps the
+    single producer of ring, and the lone producer takes the lock uncontended.
+    Has the same enqueue/waitReadyToWrite/complete semantics as FifoBuffer.
+    @note bufferSize limits the bytes in ring, slots limits the messages in ring
+*/
+class RingFifoBuffer : public FifoBuffer
+{
+public:
+    RingFifoBuffer( const std::string& bufferName, 
+                    EnqueBufferSender* owner, 
+                    u32 slots = DEF_RING_BUFFER_SLOTS );
+    virtual ~RingFifoBuffer();
+
+    /*  FifoBuffer re-implementation */
+    virtual void start( void );
+    virtual void shutdown( void );
+    virtual void complete( void );
+    virtual void perform( bool processing );
+    virtual bool isBufferReady( void ) const;
+    virtual void enqueue( const RawMessage& msg );
+    virtual bool waitReadyToWrite( u32 nBytes );
+    virtual void setBufferSize(u32 kb);
+    virtual void setLowWatermark(u32 percent);
+
+protected:
+    enum WaitFor {
+        ForRead     = 0,    /* consumer: ring is not empty */
+        ForSlot     = 1,    /* producer: ring has free slot */
+        ForWrite    = 2,    /* producer: ring has free slot and space for bytes */
+        ForFlush    = 3,    /* ring is empty or consumer is paused */
+    };
+
+    /* Thread::run implementation */
+    virtual void run( void );
+
+    /*  true when producer can write nBytes to ring */
+    inline bool isReadyToWrite( u32 nBytes ) const;
+
+    /*  true when both bytes and messages in ring are below low watermark */
+    inline bool isBelowLowWatermark( void ) const;
+
+    /*  true when thread stopped or goes to stopping */
+    inline bool isStopped( void ) const;
+
+    /*  Checks the sleeping condition of waiter */
+    bool isWaitOver( WaitFor what, u32 nBytes ) const;
+
+    /*  Sleeps the calling side on event until condition or stopping.
+        @param waiting is the sleeping flag which is seen by opposite side
+    */
+    void sleepOn( Event* ev, volatile u32* waiting, WaitFor what, u32 nBytes );
+
+    /*  Wakes up the opposite side only when it sleeps */
+    inline void wakeup( Event* ev, volatile u32* waiting );
+
+private:
+    SpscRing<RawMessage> ring_;
+    EnqueBufferSender* ringOwner_;
+
+    Mutex consumeLock_;
+    Mutex produceLock_;             /* ring has one producer at a time */
+    std::auto_ptr<Event> readReady_;
+    std::auto_ptr<Event> writeReady_;
+    std::auto_ptr<Event> flushed_;
+
+    volatile u32 running_;
+    volatile u32 processing_;
+    volatile u32 consumerWaiting_;
+    volatile u32 producerWaiting_;
+    volatile u32 flushWaiting_;
+
+    u32 lowWatermark_;
+    u32 slotsLowWatermark_;
+    volatile i64 bytesLowWatermark_;
+};
+
+inline bool RingFifoBuffer::isStopped() const {
+    return interlockedLoad32(&running_) == 0;
+}
+
+inline bool RingFifoBuffer::isReadyToWrite( u32 nBytes ) const {
+    if( ring_.full() ) 
+        return false;
+    i64 usage = interlockedLoad64(&bufferUsage_);
+    return (usage == 0) || (usage + (i64)nBytes <= bufferSize_);
+}
+
+inline bool RingFifoBuffer::isBelowLowWatermark() const {
+    return (ring_.size() <= slotsLowWatermark_) &&
+        (interlockedLoad64(&bufferUsage_) <= interlockedLoad64(&bytesLowWatermark_));
+}
+
+inline void RingFifoBuffer::wakeup( Event* ev, volatile u32* waiting ) {
+    interlockedFence();
+    if( interlockedLoad32(waiting) )
+        ev->set();
+}
+
 inline bool FifoBuffer::isBufferReadyNoLock() const {
     if( !isPerform_ ) return false;
     if( queue_.empty() ) return true;
-    return (bufferSize_ + orderToWrite_) >= getBufferUsage();
+    return (bufferSize_ + orderToWrite_) >= getBufferUsage64();
 }
 
 inline bool FifoBuffer::isBufferReady() const {
@@ -128,24 +286,27 @@ inline bool FifoBuffer::isBufferReady() const {
 }
 
 inline u32 FifoBuffer::getMessagesProcessed() const { 
-    return messagesProcessed_; 
+    return interlockedLoad32(&messagesProcessed_); 
+}
+
+inline i64 FifoBuffer::getBufferUsage64() const {
+    return interlockedLoad64(&bufferUsage_);
 }
 
 inline i32 FifoBuffer::getBufferUsage() const {
-    if( bufferUsage_ > (i64)0x80000000 )
-        throw Exception(getName() + " - FATAL: requested buffer usage size is more than 2Gb (buffer usage limitation)");
-    return (i32)bufferUsage_;
+    i64 usage = getBufferUsage64();
+    return usage > MAX_I32_USAGE ? MAX_I32_USAGE : (i32)usage;
 }
 
-inline void FifoBuffer::setBufferUsage( i32 bytes ) {
-    volatile i64* bufPtr = (volatile i64*)&bufferUsage_;
-    *bufPtr = bytes;
+inline void FifoBuffer::setBufferUsage( i64 bytes ) {
+    interlockedStore64( &bufferUsage_, bytes );
 }
 
 /**********************************************************/
 class EnqueBufferSender
 {
     friend class FifoBuffer;
+    friend class RingFifoBuffer;
 
 public:
     EnqueBufferSender( const std::string& name, 
@@ -163,6 +324,27 @@ public:
     */
     bool setOutBufferSize(u32 kb);
 
+    /*  Switches incoming buffer to lock-free SPSC ring mode
+        @param slots maximum number of messages in ring
+        @returns false when buffer is already running or we have alloc exception
+        @note should be used before start()
+    */
+    bool setInRingMode(u32 slots = DEF_RING_BUFFER_SLOTS);
+
+    /*  Switches outgoing buffer to lock-free SPSC ring mode
+        @param slots maximum number of messages in ring
+        @returns false when buffer is already running or we have alloc exception
+        @note should be used before start()
+    */
+    bool setOutRingMode(u32 slots = DEF_RING_BUFFER_SLOTS);
+
+    /*  Set low watermarks in percents of buffer size,
+        the buffer should be switched to ring mode before (see FifoBuffer::setLowWatermark)
+        @throws Exception if percent is out of range 1-100
+    */
+    inline void setInLowWatermark(u32 percent);
+    inline void setOutLowWatermark(u32 percent);
+
     /*  Attaches incoming or outgoing communicator pointer */
     void attach(Communicator* pComm, bool incomingComm);
 
@@ -199,22 +381,37 @@ public:
     */
     inline void enqueOutgoing( const RawMessage& outMsg );
 
-    /* */
+    /*  Copies data to the pooled packet and pushes it to queue,
+        the queue shares the packet, so data is copied once */
     inline void enqueIncoming( const u8* buf, u32 size );
     inline void enqueOutgoing( const u8* buf, u32 size );
 
+    /*  Pushes the pooled packet to queue without copying.
+        Caller may read data directly into the packet taken from PacketPool.
+    */
+    inline void enqueIncoming( const PacketHandle& packet, u32 size );
+    inline void enqueOutgoing( const PacketHandle& packet, u32 size );
+
     /*  Statistics for buffer usage */
     inline u32 getInMessagesProcessed( void ) const;
     inline u32 getOutMessagesProcessed( void ) const; 
     inline i32 getInBufferUsage( void ) const;
     inline i32 getOutBufferUsage( void ) const;
-    inline void setInBufferUsage( i32 bytes );
-    inline void setOutBufferUsage( i32 bytes );    
+    inline i64 getInBufferUsage64( void ) const;
+    inline i64 getOutBufferUsage64( void ) const;
+    inline void setInBufferUsage( i64 bytes );
+    inline void setOutBufferUsage( i64 bytes );    
 
 protected:
     /*  Messages callback used in FifoBuffer */
     bool on_message(const RawMessage& msg, const FifoBuffer* self, Mutex* keepLock );
 
+    /*  Messages callback used in RingFifoBuffer when several messages are queued,
+        keepLock is held while the whole batch is performed
+        @returns false when nearby communicator is not attached
+    */
+    bool on_message_batch(const RawMessage* msgs, u32 count, const FifoBuffer* self, Mutex* keepLock );
+
     /*  sender's identifiers */
     std::string name_;
 
@@ -231,6 +428,9 @@ protected:
 
 
 private:
+    /*  Replaces the buffer by RingFifoBuffer keeping the size settings */
+    bool switchToRing( std::auto_ptr<FifoBuffer>& buffer, u32 slots );
+
     std::auto_ptr<FifoBuffer> incomingBuffer_;
     std::auto_ptr<FifoBuffer> outgoingBuffer_;
 };
@@ -238,12 +438,26 @@ private:
 /*********************************************************************/
 inline void EnqueBufferSender::enqueIncoming( const u8* buf, u32 size ) { 
     assert( incomingBuffer_.get() && "EnqueBufferSender::enqueIncoming(buf,size) <null> object ptr!" );
-    incomingBuffer_->enqueue( RawMessage(buf, size) ); 
+    enqueIncoming( PacketPool::instance().acquire(buf, size), size );
 }
 
 inline void EnqueBufferSender::enqueOutgoing( const u8* buf, u32 size ) { 
     assert( outgoingBuffer_.get() && "EnqueBufferSender::enqueOutgoing(buf,size) <null> object ptr!" );
-    outgoingBuffer_->enqueue( RawMessage(buf, size) ); 
+    enqueOutgoing( PacketPool::instance().acquire(buf, size), size );
+}
+
+inline void EnqueBufferSender::enqueIncoming( const PacketHandle& packet, u32 size ) { 
+    assert( incomingBuffer_.get() && "EnqueBufferSender::enqueIncoming(packet,size) <null> object ptr!" );
+    RawMessage msg;
+    msg.attach( packet, size );
+    incomingBuffer_->enqueue( msg ); 
+}
+
+inline void EnqueBufferSender::enqueOutgoing( const PacketHandle& packet, u32 size ) { 
+    assert( outgoingBuffer_.get() && "EnqueBufferSender::enqueOutgoing(packet,size) <null> object ptr!" );
+    RawMessage msg;
+    msg.attach( packet, size );
+    outgoingBuffer_->enqueue( msg ); 
 }
 
 inline void EnqueBufferSender::enqueIncoming( const RawMessage& msg ) { 
@@ -286,15 +500,35 @@ inline i32 EnqueBufferSender::getOutBufferUsage() const {
     return outgoingBuffer_->getBufferUsage(); 
 }
 
-inline void EnqueBufferSender::setInBufferUsage( i32 bytes ) { 
+inline i64 EnqueBufferSender::getInBufferUsage64() const { 
+    assert( incomingBuffer_.get() && "EnqueBufferSender::getInBufferUsage64 <null> object ptr!" );
+    return incomingBuffer_->getBufferUsage64(); 
+}
+
+inline i64 EnqueBufferSender::getOutBufferUsage64() const { 
+    assert( outgoingBuffer_.get() && "EnqueBufferSender::getOutBufferUsage64 <null> object ptr!" );
+    return outgoingBuffer_->getBufferUsage64(); 
+}
+
+inline void EnqueBufferSender::setInBufferUsage( i64 bytes ) { 
     assert( incomingBuffer_.get() && "EnqueBufferSender::setInBufferUsage <null> object ptr!" );
     incomingBuffer_->setBufferUsage( bytes ); 
 }
 
-inline void EnqueBufferSender::setOutBufferUsage( i32 bytes ) { 
+inline void EnqueBufferSender::setOutBufferUsage( i64 bytes ) { 
     assert( outgoingBuffer_.get() && "EnqueBufferSender::setOutBufferUsage <null> object ptr!" );
     outgoingBuffer_->setBufferUsage( bytes ); 
 }
 
+inline void EnqueBufferSender::setInLowWatermark( u32 percent ) { 
+    assert( incomingBuffer_.get() && "EnqueBufferSender::setInLowWatermark <null> object ptr!" );
+    incomingBuffer_->setLowWatermark( percent ); 
+}
+
+inline void EnqueBufferSender::setOutLowWatermark( u32 percent ) { 
+    assert( outgoingBuffer_.get() && "EnqueBufferSender::setOutLowWatermark <null> object ptr!" );
+    outgoingBuffer_->setLowWatermark( percent ); 
+}
+
 /**/
 #endif /* __enque_buffer_sender_h__ */
@@ -8,13 +8,19 @@
 #include "timer.h"
 #include "task.h"
 #include "useful.h"
-#include <set>
+#include "configuration.h"
+#include "reorder_ring.h"
+#include "timing_wheel.h"
+#include "page_coalescer.h"
 
 #include <memory>
 
 #define CONNECTION_GAP_TASKNAME     "cgtask"
 #define PAGE_GAP_TASKNAME           "pgtask"
 #define SEQUENCE_GAP_TASKNAME       "sgtask"
+#define GAP_WHEEL_THREADNAME        "gapwheel"
+#define GAP_WHEEL_TICK              1           /* ms, page delays of PageCoalescer are 1-2 ms */
+#define MAX_SEQ_REORDER_WINDOW      0x80000000  /* ids of sequences reordering window */
 
 class GapDetector;
 class NotificationsMgrBase;
@@ -44,7 +50,7 @@ private:
     after the sequence gap during the time expiration 
     of gap-compensation package waiting */
 
-class SequenceGapTask : public Task
+class SequenceGapTask : public Task, public WheelTimer
 {
     friend class GapDetector;
 
@@ -52,9 +58,17 @@ public:
     SequenceGapTask( u64 clusterId, OTP_Processor* theOwner ); 
     virtual ~SequenceGapTask();
 
+    /*  Task object is reused for the next cluster deadline */
+    inline void setClusterId( u64 clusterId )
+    { clusterId_ = clusterId; }
+
 protected:
     virtual void run( void );
 
+    /* WheelTimer::expired implementation */
+    virtual void expired( void )
+    { run(); }
+
 private:
     u64 clusterId_;
     OTP_Processor* theOwner;
@@ -62,7 +76,7 @@ private:
 
 /******************************************************************/
 /*  Task to launch the pages sending after the given timeout */
-class PageGapTask : public Task
+class PageGapTask : public Task, public WheelTimer
 {
     friend class GapDetector;
 
@@ -70,9 +84,17 @@ public:
     PageGapTask( u64 clusterId, OTP_Processor* theOwner ); 
     virtual ~PageGapTask();
 
+    /*  Task object is reused for the next cluster deadline */
+    inline void setClusterId( u64 clusterId )
+    { clusterId_ = clusterId; }
+
 protected:
     virtual void run( void );
 
+    /* WheelTimer::expired implementation */
+    virtual void expired( void )
+    { run(); }
+
 private:
     u64 clusterId_;
     OTP_Processor* theOwner;
@@ -94,9 +116,9 @@ private:
     some amount of clusters with different sequences numbers from different channels.
     E.g. we have received cluster with sequence 127, and after cluster with 129. 
     So we should wait a some time to obtain cluster 128 while incoming clusters pushing in queue.
-    After the waiting is expired and no cluster recevied, we raises exception (in current implementation).
-    Behaviour is marked as "need improve" and may be solved by some controlling 
-    messages between CryptoBoxes.
+    Missed clusters are requested from the other CryptoBox by NACK control messages
+    and retransmitted (see RetransmitLink), so usually the gap costs one RTT.
+    After the waiting is expired and no cluster recevied, we raises exception.
 */
 class GapDetector : private Timer, public Communicator
 {
@@ -109,7 +131,38 @@ class GapDetector : private Timer, public Communicator
         }
     };
 
-    typedef std::set<Cluster, sequenceLess> SeqQueueT;
+    /*  Reordering window of incoming sequences keyed by the network cluster id.
+        The window holds ids of the whole gap buffer, it is sized on the first
+        insert, when the configuration is already read */
+    class SeqQueueT : public ReorderSet<Cluster> {
+    public:
+        SeqQueueT()
+            : ReorderSet<Cluster>( 0 ),
+            sized_(false)
+        {}
+
+        inline std::pair<iterator, bool> insert( const Cluster& value )
+        {
+            if( !sized_ ) {
+                assert( empty() && "GapDetector::SeqQueueT::insert Window is resized with elements!" );
+                ReorderSet<Cluster> window( windowSize() );
+                swap( window );
+                sized_ = true;
+            }
+            return ReorderSet<Cluster>::insert( value );
+        }
+
+    private:
+        static u32 windowSize( void )
+        {
+            u64 ids = (((u64)GV_OtpSeqGapBufferSize << 10) / CLUSTER_DATALEN) << CLUSTER_ID_ORDER_BITS;
+            if( ids < DEF_REORDER_WINDOW )
+                return DEF_REORDER_WINDOW;
+            return (ids < MAX_SEQ_REORDER_WINDOW) ? (u32)ids : MAX_SEQ_REORDER_WINDOW;
+        }
+
+        bool sized_;
+    };
 
 public:
     GapDetector();
@@ -117,6 +170,22 @@ public:
 
     bool sequencesCtrl( const Cluster& in, ClustersT* out, u16 headPosition );
 
+    /*  Arms or re-arms deadline of gap task in the detector timing wheel,
+        the wheel is started on the first use
+        @param delay in ms
+    */
+    inline void armGap( WheelTimer* task, u32 delay );
+
+    /*  Registers outgoing package added to the page and re-arms page delivery
+        @returns false when page should be delivered immediately
+    */
+    inline bool schedulePage( PageGapTask* task, u32 size, u32 pageFill, u32 queued );
+
+    /*  Cancels deadline of gap task
+        @returns false if deadline is already expired
+    */
+    inline bool cancelGap( WheelTimer* task );
+
 protected:
     /*  Implementation should catches all exceptions and reports about
         @returns number of processed bytes, this number used to queue clearing
@@ -133,7 +202,50 @@ private:
     SeqQueueT  seqQueue_;
     Markers64T seqGaps_;
     u32 gapBufferSize_;
+    PageCoalescer pageCoalescer_;
+
+    /*  own lock: the callers of armGap/cancelGap may hold cgtLock_ already */
+    Mutex wheelLock_;
+    std::auto_ptr<TimingWheel> gapWheel_;  /* destroyed first, stops expirations */
 };
 
+inline void GapDetector::armGap( WheelTimer* task, u32 delay )
+{
+    /*  OTP and timer threads arm gaps, the wheel is made and started once */
+    TimingWheel* wheel;
+    {
+        MGuard g( wheelLock_ );
+        if( gapWheel_.get() == NULL ) {
+            std::auto_ptr<TimingWheel> newWheel( new TimingWheel(GAP_WHEEL_THREADNAME, GAP_WHEEL_TICK) );
+            newWheel->start();
+            gapWheel_ = newWheel;
+        }
+        wheel = gapWheel_.get();
+    }
+    wheel->arm( task, delay );
+}
+
+inline bool GapDetector::schedulePage( PageGapTask* task, u32 size, u32 pageFill, u32 queued )
+{
+    u32 delay = pageCoalescer_.onPackage( size, pageFill, queued, TimingWheel::monotonicUs() );
+    if( delay == 0 ) {
+        cancelGap( task );
+        pageCoalescer_.onDelivered();
+        return false;
+    }
+    armGap( task, delay );
+    return true;
+}
+
+inline bool GapDetector::cancelGap( WheelTimer* task )
+{
+    TimingWheel* wheel;
+    {
+        MGuard g( wheelLock_ );
+        wheel = gapWheel_.get();
+    }
+    return wheel ? wheel->cancel( task ) : false;
+}
+
 /**/
 #endif /* __otp_base_h__ */
@@ -0,0 +1,86 @@
+#ifndef __interlocked_h__
+#define __interlocked_h__
+
+#include "common_defines.h"
+
+#ifdef WIN32
+    #include <windows.h>
+#endif
+
+/*******************************************************/
+/*  Lock-free primitives used by the single-producer/single-consumer
+    structures which are shared between pipeline threads.
+    @note load has acquire semantic, store has release semantic
+*/
+
+inline u32 interlockedLoad32( const u32 volatile* ptrVal )
+{
+#ifdef WIN32
+    u32 val = *ptrVal;
+    MemoryBarrier();
+    return val;
+#else
+    return __atomic_load_n( ptrVal, __ATOMIC_ACQUIRE );
+#endif
+}
+
+inline void interlockedStore32( u32 volatile* ptrVal, u32 newVal )
+{
+#ifdef WIN32
+    MemoryBarrier();
+    *ptrVal = newVal;
+#else
+    __atomic_store_n( ptrVal, newVal, __ATOMIC_RELEASE );
+#endif
+}
+
+/*  @returns new value */
+inline u32 interlockedAdd32( u32 volatile* ptrVal, i32 num )
+{
+#ifdef WIN32
+    return (u32)InterlockedExchangeAdd( (long volatile*)ptrVal, num ) + num;
+#else
+    return __atomic_add_fetch( ptrVal, num, __ATOMIC_ACQ_REL );
+#endif
+}
+
+inline i64 interlockedLoad64( const i64 volatile* ptrVal )
+{
+#ifdef WIN32
+    return InterlockedCompareExchange64( (LONGLONG volatile*)ptrVal, 0, 0 );
+#else
+    return __atomic_load_n( ptrVal, __ATOMIC_ACQUIRE );
+#endif
+}
+
+inline void interlockedStore64( i64 volatile* ptrVal, i64 newVal )
+{
+#ifdef WIN32
+    InterlockedExchange64( (LONGLONG volatile*)ptrVal, newVal );
+#else
+    __atomic_store_n( ptrVal, newVal, __ATOMIC_RELEASE );
+#endif
+}
+
+/*  @returns new value */
+inline i64 interlockedAdd64( i64 volatile* ptrVal, i64 num )
+{
+#ifdef WIN32
+    return InterlockedExchangeAdd64( (LONGLONG volatile*)ptrVal, num ) + num;
+#else
+    return __atomic_add_fetch( ptrVal, num, __ATOMIC_ACQ_REL );
+#endif
+}
+
+/*  Full memory fence (store-load ordering between the sleeping flag and queue state) */
+inline void interlockedFence( void )
+{
+#ifdef WIN32
+    MemoryBarrier();
+#else
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+#endif
+}
+
+/**/
+#endif /* __interlocked_h__ */
@@ -14,8 +14,9 @@
 #define  DEF_OTP_IMAGE_CACHE_SIZE       102400          /* 100 Mb */
 #define  DEF_OTP_IMAGE_PATH             "./imageotp"    /* image path */
 
-#define  DEF_PAGE_DELIVERY_TIMELIMIT    80              /* [mlsec] waiting time for deliverying the page 
-                                                           with a cluster what not filled completely */
+#define  DEF_PAGE_DELIVERY_TIMELIMIT    80              /* [mlsec] the longest waiting time for deliverying the page 
+                                                           with a cluster what not filled completely,
+                                                           actual waiting is adapted to traffic (PageCoalescer) */
 #define  DEF_GAP_TIME_EXPIRATION_LIMIT  10000           /* [mlsec] expiration time after what the incoming 
                                                            cluster with required sequence number not received 
                                                            from channels */
@@ -309,12 +310,12 @@ extern u32 GV_OtpOutBufferSize;
 
 inline void OTP_Processor::getTunnelBuffersUsage( i32* bytes, i32* limit ) const {
     *bytes = getInBufferUsage();
-    *limit = (GV_OtpInBufferSize << 10);
+    *limit = ((i64)GV_OtpInBufferSize << 10) > MAX_I32_USAGE ? MAX_I32_USAGE : (i32)(GV_OtpInBufferSize << 10);
 }
 
 inline void OTP_Processor::getOtpOutBuffersUsage( i32* bytes, i32* limit ) const {
     *bytes = getOutBufferUsage();
-    *limit = (GV_OtpOutBufferSize << 10);
+    *limit = ((i64)GV_OtpOutBufferSize << 10) > MAX_I32_USAGE ? MAX_I32_USAGE : (i32)(GV_OtpOutBufferSize << 10);
 }
 
 inline void OTP_Processor::interlockedInc64( u64 volatile* ptrVal ) const 
@@ -0,0 +1,115 @@
+#ifndef __otp_image_generator_h__
+#define __otp_image_generator_h__
+
+#include "common_defines.h"
+#include "mutex.h"
+#include "interlocked.h"
+
+#ifdef WIN32
+    #include <windows.h>
+#endif
+
+#include <string>
+#include <vector>
+
+/*******************************************************/
+#define DEF_OTP_GEN_CHUNK_SIZE      0x4000000   /* 64 Mb, unit of parallel work and resuming */
+#define DEF_OTP_GEN_BLOCK_SIZE      0x100000    /* 1 Mb, aligned write size */
+#define DEF_OTP_GEN_PROGRESS_STEP   5           /* [%] notifications step */
+#define OTP_GEN_PROGRESS_SUFFIX     ".progress" /* completed chunks file near the image */
+
+class NotificationsMgrBase;
+
+/*******************************************************/
+/*  Parallel OTP image generator.
+    Image is preallocated and divided to chunks which are filled by worker threads
+    with AES-256-CTR keystream. Every chunk is keyed by fresh key and IV from
+    OpenSSL RAND_bytes, so the image is never produced from the one seed.
+    Completed chunks are flushed to disk and marked in the progress file,
+    generation interrupted by crash or shutdown continues from the marked state,
+    the progress file is removed when image is completed.
+*/
+class OtpImageGenerator
+{
+public:
+    /*  @param imagesize in Mb
+        @param notifier receives progress notifications (can be NULL)
+    */
+    OtpImageGenerator( const std::string& path,
+                       u32 imagesize,
+                       NotificationsMgrBase* notifier = NULL );
+    ~OtpImageGenerator();
+
+    /*  Generates image or continues interrupted generation.
+        @param threads number of workers, 0 - by number of CPUs
+        @throws Exception if fails
+    */
+    void generate( u32 threads = 0 );
+
+    /*  Interrupts generation from another thread, generate() throws then
+        and image can be completed by the next generate() call
+    */
+    inline void cancel( void )
+    { interlockedStore32( &cancelled_, 1 ); }
+
+    /*  Progress of generation */
+    inline u64 getDoneBytes( void ) const
+    { return (u64)interlockedLoad64(&doneBytes_); }
+
+    inline u64 getImageBytes( void ) const
+    { return imageBytes_; }
+
+    /*  true when image exists and progress file shows unfinished generation */
+    static bool isInterrupted( const std::string& path );
+
+private:
+#ifdef WIN32
+    typedef HANDLE FileT;
+#else
+    typedef int FileT;
+#endif
+
+    OtpImageGenerator( const OtpImageGenerator& );
+    OtpImageGenerator& operator=( const OtpImageGenerator& );
+
+    class Worker;
+    friend class Worker;
+
+    /*  Opens and preallocates image, reads or creates progress file
+        @returns true when resumed
+    */
+    bool prepare( void );
+    void close( void );
+
+    /*  Worker thread loop: takes next unfinished chunk till the end */
+    void work( void );
+    void fillChunk( u32 chunk, u8* block );
+    void completeChunk( u32 chunk );
+    void reportProgress( void );
+
+    void writeAt( FileT fd, u64 offset, const u8* buf, u32 len );
+    void flush( FileT fd );
+
+    std::string path_;
+    std::string progressPath_;
+    NotificationsMgrBase* notifier_;
+
+    u64 imageBytes_;
+    u32 chunksNum_;
+    std::vector<u8> chunksDone_;
+
+    FileT image_;
+    FileT progress_;
+
+    Mutex lock_;
+    std::string error_;
+    u32 reportedPercent_;
+
+    volatile u32 nextChunk_;
+    volatile u32 cancelled_;
+    volatile u32 failed_;
+    volatile i64 doneBytes_;
+};
+
+/**/
+#endif /* __otp_image_generator_h__ */
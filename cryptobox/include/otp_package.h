@@ -10,6 +10,7 @@
 #define UNASSIGNED_CLUSTER_ID       0
 #define INVALID_CLUSTER_LENGTH      0
 #define FIRST_ASSIGNED_CLUSTER_ID   0x8000000000000000  /* negative 64-bit half start */
+#define CLUSTER_ID_ORDER_BITS       7                   /* order number in one cluster */
 
 #define MAX_OTPCLUSTER_SIZE         0x100E              /* 4110 bytes */ 
                                                         /* -----------------*/
@@ -35,6 +36,8 @@ public:
         ChannelTwo  = 2,
         Random      = 3,
         Different   = 4,
+        Redundant   = 5,    /* all channels, the receiver keeps the first arrival */
+        ChannelN    = 0x10, /* the third and next channels, the same as Communicator::SSLChannelN */
     };
 
     enum ChunkMaskInfo {
@@ -137,6 +140,14 @@ public:
         */
     inline void set_send_method( SendMethod method );
 
+    /*  @param index zero-based index of SSL channel
+        @returns send method of the channel (ChannelOne, ChannelTwo or ChannelN + index - 2)
+    */
+    inline static SendMethod channelMethod( u32 index );
+
+    /*  @returns zero-based index of SSL channel, -1 if method doesn't specify the channel */
+    inline static i32 channelIndex( SendMethod method );
+
     inline u64 getId( void ) const;
     inline u32 getDataLen( void ) const;
     inline SendMethod get_send_method( void ) const;
@@ -210,11 +221,11 @@ inline void Cluster::set(const u8* ptr, u16 sz)
 
 inline u64 Cluster::makeClusterIdFromNum( u64 cluster_num ) {
     /* first 7 bit - order number in one cluster */
-    return (u64)FIRST_ASSIGNED_CLUSTER_ID | (cluster_num<<7);
+    return (u64)FIRST_ASSIGNED_CLUSTER_ID | (cluster_num<<CLUSTER_ID_ORDER_BITS);
 }
 
 inline u64 Cluster::makeClusterNumFromId( u64 clusterId ) {
-    return ((u64)FIRST_ASSIGNED_CLUSTER_ID ^ clusterId)/0x80;
+    return ((u64)FIRST_ASSIGNED_CLUSTER_ID ^ clusterId)>>CLUSTER_ID_ORDER_BITS;
 }
 
 inline void Cluster::set_send_method( SendMethod method ) {
@@ -316,6 +327,18 @@ inline u32 Cluster::getDataLen() const
     return dataLen_;
 }
 
+inline Cluster::SendMethod Cluster::channelMethod( u32 index ) {
+    return (index < 2) ? (SendMethod)(ChannelOne + index) : (SendMethod)(ChannelN + index - 2);
+}
+
+inline i32 Cluster::channelIndex( SendMethod method ) {
+    if( method == ChannelOne || method == ChannelTwo )
+        return (i32)method - ChannelOne;
+    if( method >= ChannelN )
+        return (i32)method - ChannelN + 2;
+    return -1;
+}
+
 inline Cluster::SendMethod Cluster::get_send_method() const {
     return (Cluster::SendMethod)sendMethod_;
 }
@@ -0,0 +1,181 @@
+#ifndef __packet_pool_h__
+#define __packet_pool_h__
+
+#include "common_defines.h"
+#include "mutex.h"
+#include "interlocked.h"
+
+#include <vector>
+
+/***********************************************************/
+#define PACKET_POOL_CLASSES         3
+#define PACKET_POOL_SMALL_SIZE      0x800       /* 2Kb, MTU sized frames */
+#define PACKET_POOL_MEDIUM_SIZE     0x1100      /* 4352 bytes, OTP cluster with header */
+#define PACKET_POOL_LARGE_SIZE      0x10010     /* TUN device read with header */
+#define DEF_PACKET_POOL_KEEP        0x400       /* free blocks retained per size class */
+
+class PacketPool;
+
+/***********************************************************/
+/*  Reference counted block of packet memory. Data follows the header
+    in the same allocation, so acquiring of block from the pool costs
+    neither heap allocation nor memset.
+*/
+class PacketBuffer
+{
+friend class PacketPool;
+friend class PacketHandle;
+public:
+    inline u8* data( void )
+    { return reinterpret_cast<u8*>(this + 1); }
+
+    inline const u8* data( void ) const
+    { return reinterpret_cast<const u8*>(this + 1); }
+
+    inline u32 capacity( void ) const
+    { return capacity_; }
+
+private:
+    PacketBuffer( u32 capacity, u32 sizeClass );
+
+    inline void addRef( void );
+    inline void release( void );
+
+    volatile u32 refs_;
+    u32 capacity_;
+    u32 sizeClass_;
+    u32 reserved_;      /* keeps data() aligned on 8 bytes */
+};
+
+/***********************************************************/
+/*  Shared handle to the PacketBuffer. Copying of handle increments the
+    reference counter, the block goes back to the pool when the last
+    handle is released.
+*/
+class PacketHandle
+{
+public:
+    PacketHandle()
+        : buffer_(NULL)
+    {}
+
+    explicit PacketHandle( PacketBuffer* buffer )
+        : buffer_(buffer)
+    {}
+
+    PacketHandle( const PacketHandle& handle )
+        : buffer_(handle.buffer_)
+    { if( buffer_ ) buffer_->addRef(); }
+
+    ~PacketHandle()
+    { reset(); }
+
+    inline PacketHandle& operator=( const PacketHandle& handle );
+
+    /*  Moves ownership between handles without touching of counter */
+    inline void swap( PacketHandle& handle );
+    inline void reset( void );
+
+    inline PacketBuffer* get( void ) const
+    { return buffer_; }
+
+    inline PacketBuffer* operator->( void ) const
+    { return buffer_; }
+
+private:
+    PacketBuffer* buffer_;
+};
+
+/***********************************************************/
+/*  Process wide pool of packet buffers sorted by size classes.
+    Blocks larger than the largest class are allocated on demand and freed
+    on release, so pool never keeps more than DEF_PACKET_POOL_KEEP blocks
+    of each class.
+*/
+class PacketPool
+{
+friend class PacketBuffer;
+public:
+    static PacketPool& instance( void );
+
+    /*  Takes the block with capacity for size bytes at least
+        @throws std::bad_alloc
+    */
+    PacketHandle acquire( u32 size );
+
+    /*  Takes the block and copies srcBuf into it. The only copy on the
+        enqueue path when data comes from the foreign memory.
+    */
+    PacketHandle acquire( const u8* srcBuf, u32 size );
+
+    /*  Statistics */
+    inline u64 getAllocated( void ) const;
+    inline u64 getReused( void ) const;
+
+private:
+    PacketPool();
+    ~PacketPool();
+    PacketPool( const PacketPool& );
+    PacketPool& operator=( const PacketPool& );
+
+    static u32 classBySize( u32 size );
+    static u32 classCapacity( u32 sizeClass );
+
+    void recycle( PacketBuffer* buffer );
+
+    typedef std::vector<PacketBuffer*> FreeListT;
+
+    Mutex     lock_[PACKET_POOL_CLASSES];
+    FreeListT free_[PACKET_POOL_CLASSES];
+
+    volatile i64 allocated_;
+    volatile i64 reused_;
+};
+
+/***********************************************************/
+inline void PacketBuffer::addRef( void ) {
+    interlockedAdd32( &refs_, 1 );
+}
+
+inline void PacketBuffer::release( void ) {
+    if( interlockedAdd32( &refs_, -1 ) == 0 )
+        PacketPool::instance().recycle( this );
+}
+
+inline PacketHandle& PacketHandle::operator=( const PacketHandle& handle )
+{
+    if( buffer_ != handle.buffer_ ) {
+        if( handle.buffer_ )
+            handle.buffer_->addRef();
+        reset();
+        buffer_ = handle.buffer_;
+    }
+    return *this;
+}
+
+inline void PacketHandle::swap( PacketHandle& handle )
+{
+    PacketBuffer* tmp = buffer_;
+    buffer_ = handle.buffer_;
+    handle.buffer_ = tmp;
+}
+
+inline void PacketHandle::reset( void )
+{
+    if( buffer_ ) {
+        PacketBuffer* tmp = buffer_;
+        buffer_ = NULL;
+        tmp->release();
+    }
+}
+
+inline u64 PacketPool::getAllocated( void ) const {
+    return (u64)interlockedLoad64(&allocated_);
+}
+
+inline u64 PacketPool::getReused( void ) const {
+    return (u64)interlockedLoad64(&reused_);
+}
+
+/**/
+#endif /* __packet_pool_h__ */
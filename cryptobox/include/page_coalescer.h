@@ -0,0 +1,65 @@
+#ifndef __page_coalescer_h__
+#define __page_coalescer_h__
+
+#include "common_defines.h"
+#include "otp_package.h"
+
+/*******************************************************/
+#define PAGE_EWMA_SHIFT             3       /* 1/8 weight of the new sample */
+#define PAGE_IDLE_FACTOR            4       /* gap of idle link in mean inter-arrivals */
+#define PAGE_QUEUED_DELAY           1       /* ms, queued packages are added to page right away */
+
+/*******************************************************/
+/*  Adaptive delivery policy of not filled page (cluster).
+    Tracks the mean inter-arrival time and size of outgoing packages:
+    - idle link (next package isn't expected within the latency limit)
+      delivers the page immediately, interactive traffic isn't delayed;
+    - dense traffic coalesces the page up to CLUSTER_DATALEN but holds
+      it not longer than expected time of filling;
+    - packages waiting in queue hold the page for PAGE_QUEUED_DELAY only,
+      the delay is decided again when they are added;
+    - the page is never held longer than the latency limit.
+    All times are in microseconds of TimingWheel::monotonicUs().
+*/
+class PageCoalescer
+{
+public:
+    /*  @param latencyLimit in ms, the page holding limit (SLO),
+            0 - GV_OtpPageDeliveryTimelimit read on every package,
+            so the configuration can be loaded after construction
+    */
+    explicit PageCoalescer( u32 latencyLimit = 0 );
+
+    inline void setLatencyLimit( u32 latencyLimit )
+    { latencyLimit_ = latencyLimit; }
+
+    /*  Registers package added to the current page
+        @param size of package
+        @param pageFill bytes of page after the package
+        @param queued number of packages waiting in outgoing queue yet
+        @param now time of arrival
+        @returns delay in ms to deliver the page after, 0 - deliver now
+    */
+    u32 onPackage( u32 size, u32 pageFill, u32 queued, u64 now );
+
+    /*  Page is delivered, holding time is over */
+    inline void onDelivered( void )
+    { pageStart_ = 0; }
+
+    /*  Mean inter-arrival time in us */
+    inline u64 getMeanGap( void ) const
+    { return meanGap_; }
+
+private:
+    /*  Holding limit in us */
+    u64 getLimit( void ) const;
+
+    u32 latencyLimit_;
+    u64 lastArrival_;
+    u64 pageStart_;     /* arrival of the first package of page, 0 if page is empty */
+    u64 meanGap_;
+    u64 meanSize_;
+};
+
+/**/
+#endif /* __page_coalescer_h__ */
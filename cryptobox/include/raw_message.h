@@ -3,6 +3,10 @@
 
 #include "message.h"
 #include "connection.h"
+#include "packet_pool.h"
+
+#include <memory>
+#include <new>
 
 /***********************************************************/
 #define MAX_RAWPACKAGE_SIZE     0x100000     /* 1Mb */
@@ -59,6 +63,22 @@ public:
 
     inline RawMessage& operator=( const RawMessage& message );
 
+    /*  Wraps the pooled packet without copying. Assignment of the wrapped
+        message shares the packet instead of copying of its data, the same
+        works for Cluster, IPPackage and AESPackage successors.
+        @param packet block which holds the message with header
+        @param size number of bytes used in block
+        @note message should be empty or wrapping another packet (asserted),
+        assignment copies the pooled data into the owned buffer instead
+    */
+    inline void attach( const PacketHandle& packet, u32 size );
+
+    /*  Drops the reference to the pooled packet (if any), the message becomes empty */
+    inline void detach( void );
+
+    inline bool isPooled( void ) const
+    { return packet_.get() != NULL; }
+
     inline u8   getVersion( void ) const;
     inline PackageType getType() const;
     inline u64  getId( void ) const;
@@ -122,9 +142,49 @@ protected:
     u8   sendMethod_;
 
     MarkersT aesMarkers_;
+
+    PacketHandle packet_;
+};
+
+/**************************************************************************/
+/*  Allocator of queue elements: element is made by assignment to the empty
+    message, so the queued copy of pooled message shares its packet instead
+    of copying the data (the copy constructor makes the owned buffer).
+*/
+template<typename T>
+class SharingAllocator : public std::allocator<T>
+{
+public:
+    template<typename U>
+    struct rebind { typedef SharingAllocator<U> other; };
+
+    SharingAllocator()
+    {}
+
+    SharingAllocator( const SharingAllocator& alloc )
+        : std::allocator<T>(alloc)
+    {}
+
+    template<typename U>
+    SharingAllocator( const SharingAllocator<U>& alloc )
+        : std::allocator<T>(alloc)
+    {}
+
+    inline void construct( T* p, const T& value )
+    {
+        ::new((void*)p) T();
+        try {
+            *p = value;
+        }
+        catch( ... ) {
+            p->~T();
+            throw;
+        }
+    }
 };
+
 typedef std::vector<RawMessage> RawMessagesT;
-typedef std::queue<RawMessage>  RawMessagesQueueT;
+typedef std::queue< RawMessage, std::deque<RawMessage, SharingAllocator<RawMessage> > > RawMessagesQueueT;
 
 /**************************************************************************/
 inline RawMessage* RawMessage::castToRaw( const Message& message )
@@ -145,7 +205,14 @@ inline RawMessage* RawMessage::castToRaw( const u8* pBuffer, u32 bufferSize )
 
 inline RawMessage& RawMessage::operator=( const RawMessage& message )
 {
-    *(Message*)this = message;
+    /*  owned buffer of target is reused by copying, the empty one shares the packet */
+    if( message.packet_.get() && (packet_.get() || buffer_ == NULL) ) {
+        attach( message.packet_, message.size() );
+    }
+    else {
+        detach();
+        *(Message*)this = message;
+    }
     version_    = message.version_;
     type_       = message.type_;
     headerLen_  = message.headerLen_;
@@ -160,6 +227,27 @@ inline RawMessage& RawMessage::operator=( const RawMessage& message )
     return *this;
 }
 
+inline void RawMessage::attach( const PacketHandle& packet, u32 size )
+{
+    assert( packet.get() && (size <= packet->capacity()) && "RawMessage::attach Invalid packet!" );
+    assert( (packet_.get() || buffer_ == NULL) && "RawMessage::attach Message owns buffer!" );
+
+    PacketHandle keep( packet );
+    set_protected_using(size);
+    buffer_ = keep->data();
+    packet_.swap( keep );
+}
+
+inline void RawMessage::detach( void )
+{
+    if( packet_.get() ) {
+        /*  the block can be recycled, the message is left empty */
+        set_protected_using(0);
+        buffer_ = NULL;
+        packet_.reset();
+    }
+}
+
 inline u8 RawMessage::getVersion() const { 
     return version_; 
 }
@@ -213,7 +301,9 @@ inline void RawMessage::setData( const u8* ptr, u16 sz )
 { 
     assert( sz && ptr && "RawMessage::setData <null> input data!" );
 
+    /*  the pooled block is shared by other handles, data goes to own buffer */
     sz = sz > maxDataLen_ ? (u16)maxDataLen_ : sz;
+    detach();
     set_protected_using(0);
     reserve(sz + headerLen_);
     memcpy(buffer_ + headerLen_, ptr, sz);
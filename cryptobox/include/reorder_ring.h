@@ -0,0 +1,502 @@
+#ifndef __reorder_ring_h__
+#define __reorder_ring_h__
+
+#include "common_defines.h"
+
+#include <cassert>
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <new>
+
+#define DEF_REORDER_WINDOW      0x8000  /* slots: 256 image clusters by 128 network cluster ids */
+
+/*******************************************************/
+/*  Ordered container for dense monotonic keys (cluster identifiers).
+    Keys which are in the window [base, base + capacity) are stored in the ring
+    slot (key mod capacity) with the occupancy bit, so insert, find and erase
+    cost O(1) and slots storage is reused without node allocation.
+    Rare keys out of the window (very late or far ahead) are kept in the
+    overflow map. Iteration merges both in the ascending order of keys.
+    Has the subset of std::map interface without reverse iteration and hints.
+    @note iterators are invalidated by erasing of the element they point to
+*/
+template<typename T>
+class ReorderRing
+{
+public:
+    typedef u64 key_type;
+    typedef T   mapped_type;
+
+    struct value_type {
+        value_type()
+            : first(0)
+        {}
+        value_type( u64 key, const T& value )
+            : first(key), second(value)
+        {}
+
+        u64 first;
+        T   second;
+    };
+
+private:
+    typedef std::map<u64, value_type> OverflowT;
+    enum { NoKey = 0 };     /* UNASSIGNED_CLUSTER_ID is never stored */
+
+public:
+    class iterator
+    {
+        friend class ReorderRing;
+    public:
+        iterator()
+            : owner_(NULL), ringKey_(NoKey)
+        {}
+
+        inline value_type& operator*( void ) const
+        { return *get(); }
+
+        inline value_type* operator->( void ) const
+        { return get(); }
+
+        inline iterator& operator++( void );
+        inline iterator operator++( int )
+        { iterator tmp(*this); ++(*this); return tmp; }
+
+        inline bool operator==( const iterator& it ) const
+        { return ringKey_ == it.ringKey_ && overIt_ == it.overIt_; }
+
+        inline bool operator!=( const iterator& it ) const
+        { return !(*this == it); }
+
+    private:
+        iterator( ReorderRing* owner, u64 ringKey, typename OverflowT::iterator overIt )
+            : owner_(owner), ringKey_(ringKey), overIt_(overIt)
+        {}
+
+        /*  true when current element is in the ring (lesser key of both sequences) */
+        inline bool inRing( void ) const;
+        inline value_type* get( void ) const;
+
+        ReorderRing* owner_;
+        u64 ringKey_;                           /* NoKey when ring sequence is over */
+        typename OverflowT::iterator overIt_;   /* end() when overflow sequence is over */
+    };
+    typedef iterator const_iterator;
+
+public:
+    /*  @param capacity window size (rounded up to power of two, 64 at least) */
+    explicit ReorderRing( u32 capacity = DEF_REORDER_WINDOW );
+
+    inline iterator begin( void ) const;
+    inline iterator end( void ) const;
+    inline iterator find( u64 key ) const;
+    inline iterator lower_bound( u64 key ) const;
+
+    inline iterator upper_bound( u64 key ) const
+    { return lower_bound( key + 1 ); }
+
+    inline size_t count( u64 key ) const
+    { return find(key) != end() ? 1 : 0; }
+
+    /*  Inserts copy of value when key is not presented
+        @returns iterator to element with key and true when inserted
+    */
+    std::pair<iterator, bool> insert( const value_type& value );
+
+    template<typename K>
+    inline std::pair<iterator, bool> insert( const std::pair<K, T>& value )
+    { return insert( value_type((u64)value.first, value.second) ); }
+
+    /*  Returns element with key, default one is inserted when missed */
+    T& operator[]( u64 key );
+
+    void erase( iterator it );
+    size_t erase( u64 key );
+    void erase( iterator first, iterator last );
+    void clear( void );
+    void swap( ReorderRing& ring );
+
+    inline bool empty( void ) const
+    { return size_ == 0; }
+
+    inline size_t size( void ) const
+    { return size_; }
+
+    /*  Elements which are out of the window (statistics) */
+    inline size_t overflowed( void ) const
+    { return overflow_.size(); }
+
+private:
+    inline u32 slot( u64 key ) const
+    { return (u32)(key & mask_); }
+
+    inline bool inWindow( u64 key ) const
+    { return (key >= base_) && (key - base_ <= mask_); }
+
+    inline bool isOccupied( u64 key ) const
+    { u32 s = slot(key); return (bits_[s >> 6] >> (s & 63)) & 1; }
+
+    inline void setOccupied( u64 key, bool occupied );
+
+    /*  Releases data of erased slot (e.g. packet or buffer of message),
+        assignment of the empty value would keep the storage */
+    inline void release( u64 key );
+
+    /*  First occupied key in [from, base + capacity) or NoKey */
+    u64 nextOccupied( u64 from ) const;
+
+    /*  Moves window to key when it is possible without moving of elements */
+    bool slideTo( u64 key );
+
+    std::vector<value_type> slots_;
+    std::vector<u64> bits_;
+    u64 mask_;
+    u64 base_;
+    size_t ringSize_;
+    size_t size_;
+
+    mutable OverflowT overflow_;
+};
+
+/*******************************************************/
+template<typename T>
+inline bool ReorderRing<T>::iterator::inRing( void ) const
+{
+    if( ringKey_ == NoKey )
+        return false;
+    return (overIt_ == owner_->overflow_.end()) || (ringKey_ < overIt_->first);
+}
+
+template<typename T>
+inline typename ReorderRing<T>::value_type* ReorderRing<T>::iterator::get( void ) const
+{
+    assert( (ringKey_ != NoKey || overIt_ != owner_->overflow_.end()) &&
+            "ReorderRing::iterator Dereferencing of end iterator!" );
+    if( inRing() )
+        return &owner_->slots_[owner_->slot(ringKey_)];
+    return &overIt_->second;
+}
+
+template<typename T>
+inline typename ReorderRing<T>::iterator& ReorderRing<T>::iterator::operator++( void )
+{
+    if( inRing() )
+        ringKey_ = owner_->nextOccupied( ringKey_ + 1 );
+    else
+        ++overIt_;
+    return *this;
+}
+
+/*******************************************************/
+template<typename T>
+ReorderRing<T>::ReorderRing( u32 capacity )
+    : mask_(0),
+    base_(0),
+    ringSize_(0),
+    size_(0)
+{
+    u64 cap = 64;
+    while( cap < capacity )
+        cap <<= 1;
+
+    mask_ = cap - 1;
+    slots_.resize( (size_t)cap );
+    bits_.resize( (size_t)(cap >> 6), 0 );
+}
+
+template<typename T>
+inline void ReorderRing<T>::setOccupied( u64 key, bool occupied )
+{
+    u32 s = slot(key);
+    if( occupied )
+        bits_[s >> 6] |= ((u64)1 << (s & 63));
+    else
+        bits_[s >> 6] &= ~((u64)1 << (s & 63));
+}
+
+template<typename T>
+inline void ReorderRing<T>::release( u64 key )
+{
+    T& value = slots_[slot(key)].second;
+    value.~T();
+    ::new((void*)&value) T();
+}
+
+template<typename T>
+u64 ReorderRing<T>::nextOccupied( u64 from ) const
+{
+    if( ringSize_ == 0 )
+        return NoKey;
+    if( from < base_ )
+        from = base_;
+
+    u64 limit = base_ + mask_ + 1;
+    while( from < limit )
+    {
+        u32 s = slot(from);
+        u64 word = bits_[s >> 6] >> (s & 63);
+        if( word ) {
+            while( (word & 1) == 0 ) {
+                word >>= 1;
+                ++from;
+            }
+            return from < limit ? from : (u64)NoKey;
+        }
+        from += 64 - (s & 63);
+    }
+    return NoKey;
+}
+
+template<typename T>
+bool ReorderRing<T>::slideTo( u64 key )
+{
+    if( ringSize_ == 0 ) {
+        base_ = key;
+        return true;
+    }
+
+    /*  slots below the first element are free, window can start from it */
+    u64 first = nextOccupied( base_ );
+    if( key >= first && key - first <= mask_ ) {
+        base_ = first;
+        return true;
+    }
+    return false;
+}
+
+template<typename T>
+inline typename ReorderRing<T>::iterator ReorderRing<T>::begin( void ) const
+{
+    ReorderRing* self = const_cast<ReorderRing*>(this);
+    return iterator( self, nextOccupied(base_), overflow_.begin() );
+}
+
+template<typename T>
+inline typename ReorderRing<T>::iterator ReorderRing<T>::end( void ) const
+{
+    ReorderRing* self = const_cast<ReorderRing*>(this);
+    return iterator( self, NoKey, overflow_.end() );
+}
+
+template<typename T>
+inline typename ReorderRing<T>::iterator ReorderRing<T>::lower_bound( u64 key ) const
+{
+    ReorderRing* self = const_cast<ReorderRing*>(this);
+    return iterator( self, nextOccupied(key), overflow_.lower_bound(key) );
+}
+
+template<typename T>
+inline typename ReorderRing<T>::iterator ReorderRing<T>::find( u64 key ) const
+{
+    ReorderRing* self = const_cast<ReorderRing*>(this);
+    if( ringSize_ && inWindow(key) && isOccupied(key) ) {
+        /*  iterator should point to the element, so overflow is positioned after key */
+        return iterator( self, key, overflow_.upper_bound(key) );
+    }
+
+    typename OverflowT::iterator It = overflow_.find( key );
+    if( It == overflow_.end() )
+        return end();
+    return iterator( self, nextOccupied(key + 1), It );
+}
+
+template<typename T>
+std::pair<typename ReorderRing<T>::iterator, bool> ReorderRing<T>::insert( const value_type& value )
+{
+    u64 key = value.first;
+    assert( (key != NoKey) && "ReorderRing::insert Invalid key!" );
+
+    iterator It = find( key );
+    if( It != end() )
+        return std::make_pair( It, false );
+
+    if( inWindow(key) || slideTo(key) )
+    {
+        value_type& entry = slots_[slot(key)];
+        entry.first = key;
+        entry.second = value.second;    /* slot storage is reused */
+        setOccupied( key, true );
+        ++ringSize_;
+        ++size_;
+        return std::make_pair( find(key), true );
+    }
+
+    overflow_.insert( std::make_pair(key, value) );
+    ++size_;
+    return std::make_pair( find(key), true );
+}
+
+template<typename T>
+T& ReorderRing<T>::operator[]( u64 key )
+{
+    iterator It = find( key );
+    if( It == end() )
+        It = insert( value_type(key, T()) ).first;
+    return It->second;
+}
+
+template<typename T>
+void ReorderRing<T>::erase( iterator it )
+{
+    assert( (it != end()) && "ReorderRing::erase Erasing of end iterator!" );
+    if( it.inRing() ) {
+        setOccupied( it.ringKey_, false );
+        release( it.ringKey_ );
+        --ringSize_;
+    }
+    else
+        overflow_.erase( it.overIt_ );
+    --size_;
+}
+
+template<typename T>
+size_t ReorderRing<T>::erase( u64 key )
+{
+    iterator It = find( key );
+    if( It == end() )
+        return 0;
+    erase( It );
+    return 1;
+}
+
+template<typename T>
+void ReorderRing<T>::erase( iterator first, iterator last )
+{
+    /*  the next element is taken before erasing, erasing doesn't move the rest */
+    while( first != last )
+        erase( first++ );
+}
+
+template<typename T>
+void ReorderRing<T>::swap( ReorderRing& ring )
+{
+    slots_.swap( ring.slots_ );
+    bits_.swap( ring.bits_ );
+    overflow_.swap( ring.overflow_ );
+    std::swap( mask_, ring.mask_ );
+    std::swap( base_, ring.base_ );
+    std::swap( ringSize_, ring.ringSize_ );
+    std::swap( size_, ring.size_ );
+}
+
+template<typename T>
+void ReorderRing<T>::clear( void )
+{
+    for( u64 key = nextOccupied(base_); key != NoKey; key = nextOccupied(key + 1) )
+        release( key );
+    for( size_t i = 0; i < bits_.size(); ++i )
+        bits_[i] = 0;
+    overflow_.clear();
+    ringSize_ = 0;
+    size_ = 0;
+}
+
+/*******************************************************/
+/*  Ordered set of elements keyed by getId(), the ReorderRing storage
+    with the subset of std::set interface (e.g. sequences reordering queue).
+*/
+template<typename T>
+class ReorderSet
+{
+    typedef ReorderRing<T> RingT;
+
+public:
+    typedef T key_type;
+    typedef T value_type;
+
+    class iterator
+    {
+        friend class ReorderSet;
+    public:
+        iterator()
+        {}
+
+        inline const T& operator*( void ) const
+        { return it_->second; }
+
+        inline const T* operator->( void ) const
+        { return &it_->second; }
+
+        inline iterator& operator++( void )
+        { ++it_; return *this; }
+        inline iterator operator++( int )
+        { iterator tmp(*this); ++it_; return tmp; }
+
+        inline bool operator==( const iterator& it ) const
+        { return it_ == it.it_; }
+
+        inline bool operator!=( const iterator& it ) const
+        { return it_ != it.it_; }
+
+    private:
+        explicit iterator( const typename RingT::iterator& it )
+            : it_(it)
+        {}
+
+        typename RingT::iterator it_;
+    };
+    typedef iterator const_iterator;
+
+public:
+    /*  @see ReorderRing::ReorderRing */
+    explicit ReorderSet( u32 capacity = DEF_REORDER_WINDOW )
+        : ring_(capacity)
+    {}
+
+    inline iterator begin( void ) const
+    { return iterator( ring_.begin() ); }
+
+    inline iterator end( void ) const
+    { return iterator( ring_.end() ); }
+
+    inline iterator find( const T& value ) const
+    { return iterator( ring_.find(value.getId()) ); }
+
+    inline iterator lower_bound( const T& value ) const
+    { return iterator( ring_.lower_bound(value.getId()) ); }
+
+    inline iterator upper_bound( const T& value ) const
+    { return iterator( ring_.upper_bound(value.getId()) ); }
+
+    inline size_t count( const T& value ) const
+    { return ring_.count( value.getId() ); }
+
+    inline std::pair<iterator, bool> insert( const T& value )
+    {
+        std::pair<typename RingT::iterator, bool> res =
+            ring_.insert( typename RingT::value_type(value.getId(), value) );
+        return std::make_pair( iterator(res.first), res.second );
+    }
+
+    inline void erase( iterator it )
+    { ring_.erase( it.it_ ); }
+
+    inline size_t erase( const T& value )
+    { return ring_.erase( value.getId() ); }
+
+    inline void erase( iterator first, iterator last )
+    { ring_.erase( first.it_, last.it_ ); }
+
+    inline void swap( ReorderSet& set )
+    { ring_.swap( set.ring_ ); }
+
+    inline void clear( void )
+    { ring_.clear(); }
+
+    inline bool empty( void ) const
+    { return ring_.empty(); }
+
+    inline size_t size( void ) const
+    { return ring_.size(); }
+
+    inline size_t overflowed( void ) const
+    { return ring_.overflowed(); }
+
+private:
+    RingT ring_;
+};
+
+/**/
+#endif /* __reorder_ring_h__ */
@@ -0,0 +1,360 @@
+#ifndef __retransmit_link_h__
+#define __retransmit_link_h__
+
+#include "otp_package.h"
+#include "enque_buffer_sender.h"
+#include "timing_wheel.h"
+#include "reorder_ring.h"
+#include "duplicate_filter.h"
+#include "mutex.h"
+
+#include <vector>
+#include <list>
+
+/*******************************************************/
+#define DEF_RETRANSMIT_STORE_SIZE   4096    /* [Kb] encoded clusters kept for retransmit */
+#define DEF_NACK_REORDER_DELAY      3       /* [mlsec] gap can be closed by the other channel yet */
+#define DEF_NACK_MIN_RETRY          20      /* [mlsec] the shortest NACK repeating interval */
+#define DEF_NACK_RETRIES            5       /* NACKs per gap, GapDetector expiration works after */
+#define MAX_NACK_RANGES             ((CLUSTER_DATALEN - 4) / 16)
+
+#define DEF_FEC_HISTORY_SIZE        1024    /* [Kb] received clusters kept for parity rebuilding */
+#define DEF_FEC_PENDING_GROUPS      64      /* parity groups waiting for members */
+#define MAX_FEC_GROUP_SIZE          64      /* data clusters per parity */
+#define FEC_STRIPE_SIZE             0x800   /* parity data per control message, 2 stripes per cluster */
+
+/*  Control message is framed as cluster with the positive id (network clusters are negative),
+    data of NACK: u16 type, u16 number of ranges, ranges [from, to) of 64-bit cluster ids;
+    data of parity: u16 type, u16 number of clusters, u16 max data length, u16 stripe offset,
+    64-bit ids of clusters, XOR of u16 chunkIds, XOR of u32 used lengths, XOR of stripe data */
+#define CONTROL_CLUSTER_ID          0x000000004B43414E  /* "NACK" */
+#define CONTROL_NACK                1
+#define CONTROL_PARITY              2
+
+class NotificationsMgrBase;
+class SSL_Tunnel;
+
+/*******************************************************/
+/*  Range of missed cluster ids [from, to) */
+struct ClusterIdRange {
+    u64 from;
+    u64 to;
+};
+typedef std::vector<ClusterIdRange> ClusterIdRangesT;
+
+/*******************************************************/
+/*  Bounded store of the sent (encoded) clusters by id.
+    The oldest clusters are evicted when store size is exceeded.
+*/
+class RetransmitStore
+{
+public:
+    struct Entry {
+        Entry() : size(0), method(Cluster::Undefined) {}
+
+        PacketHandle packet;
+        u32 size;
+        Cluster::SendMethod method;
+    };
+
+    /*  @param maxSize in Kb */
+    explicit RetransmitStore( u32 maxSize = DEF_RETRANSMIT_STORE_SIZE );
+
+    void store( u64 id, const u8* cluster, u32 size, Cluster::SendMethod method );
+
+    /*  Appends stored clusters with ids in range
+        @returns number of appended clusters
+    */
+    u32 fetch( const ClusterIdRange& range, std::vector<Entry>* out ) const;
+
+    inline u64 getStoredBytes( void ) const
+    { return bytes_; }
+
+private:
+    ReorderRing<Entry> clusters_;
+    u64 maxBytes_;
+    u64 bytes_;
+};
+
+/*******************************************************/
+/*  Receiver side gaps tracking. Network cluster ids are dense:
+    the next id after the cluster which ends the image cluster
+    is the first id of the next image cluster, otherwise it's id + 1.
+*/
+class NackTracker
+{
+public:
+    NackTracker();
+
+    /*  Registers received cluster
+        @returns false if cluster is duplicate (retransmitted after arrival)
+    */
+    bool onCluster( u64 id, bool endOfCluster, u64 now );
+
+    /*  Takes ranges which should be NACKed now, gaps without answer
+        after DEF_NACK_RETRIES NACKs are left to GapDetector
+        @returns time of the next NACK or 0 if there are no gaps
+    */
+    u64 collect( u64 now, ClusterIdRangesT* out );
+
+    /*  @returns time of the next NACK or 0 if there are no gaps */
+    u64 nextDue( void ) const;
+
+    /*  Smoothed time from NACK till the recovery in us */
+    inline u64 getRtt( void ) const
+    { return srtt_; }
+
+private:
+    struct Gap {
+        ClusterIdRange range;
+        u64 due;
+        u64 sent;
+        u32 tries;
+    };
+    typedef std::vector<Gap> GapsT;
+
+    void addGap( u64 from, u64 to, u64 due );
+    u64 retryInterval( u32 tries ) const;
+
+    GapsT gaps_;
+    u64 expected_;      /* next id in order, 0 - unknown */
+    u64 srtt_;
+};
+
+/*******************************************************/
+/*  Sender side FEC: XOR parity of every group of K data clusters.
+    Parity of full clusters doesn't fit one cluster with the group description,
+    so it's sent by stripes of FEC_STRIPE_SIZE.
+*/
+class FecEncoder
+{
+public:
+    /*  @param groupSize K data clusters per parity, 0 - FEC is off */
+    explicit FecEncoder( u32 groupSize = 0 );
+
+    /*  Starts the new group with the new size */
+    void setGroupSize( u32 groupSize );
+
+    inline u32 getGroupSize( void ) const
+    { return groupSize_; }
+
+    /*  Adds data cluster frame (header and data) to the current group
+        @param parity receives parity frames when the group is completed
+        @returns number of parity frames
+    */
+    u32 add( const u8* frame, u32 len, std::vector<u8>* parity );
+
+private:
+    void reset( void );
+
+    u32 groupSize_;
+    std::vector<u64> ids_;
+    u16 xorChunk_;
+    u32 xorUsed_;
+    u32 dataLen_;
+    u8  acc_[CLUSTER_DATALEN];
+};
+
+/*******************************************************/
+/*  Receiver side FEC: rebuilds the single missed cluster of group
+    from parity and the other clusters kept in the history.
+*/
+class FecDecoder
+{
+public:
+    /*  @param historySize in Kb */
+    explicit FecDecoder( u32 historySize = DEF_FEC_HISTORY_SIZE );
+
+    /*  Registers received data cluster frame
+        @param rebuilt receives frames of rebuilt clusters
+    */
+    void onData( u64 id, const u8* frame, u32 len, std::vector<u8>* rebuilt );
+
+    /*  Registers parity control message (data without header) */
+    void onParity( const u8* data, u32 len, std::vector<u8>* rebuilt );
+
+    /*  History is kept after the first parity only */
+    inline bool isActive( void ) const
+    { return active_; }
+
+    inline u64 getRebuilt( void ) const
+    { return rebuilt_; }
+
+private:
+    struct Group {
+        std::vector<u64> ids;
+        u32 dataLen;
+        u32 stripes;        /* mask of received stripes */
+        u16 xorChunk;
+        u32 xorUsed;
+        u8  parity[CLUSTER_DATALEN];
+    };
+    typedef std::list<Group> GroupsT;
+
+    /*  @returns true when group is resolved (rebuilt or nothing is missed) */
+    bool tryRebuild( const Group& group, std::vector<u8>* rebuilt );
+
+    RetransmitStore history_;
+    GroupsT groups_;
+    bool active_;
+    u64 rebuilt_;
+};
+
+/*******************************************************/
+/*  Selective retransmit between cryptoboxes. The link is placed between
+    OTP processor and SSL tunnel: outgoing clusters are kept in the store,
+    incoming ones are tracked and the missed ranges are NACKed by control
+    message over the channel next to the one of gap, the peer resends them from
+    its store over the channel next to the one of original sending. So the lost cluster costs one RTT
+    instead of the sequence gap expiration.
+    With FEC group set the link also sends XOR parity of every K clusters over
+    the channel next to data, so the single lost cluster of group is rebuilt
+    by the peer without any waiting.
+    Clusters with Redundant send method (or all of them in redundant mode) are
+    sent over all channels, the receiver passes the first arrived copy only,
+    so the loss or delay of one channel costs nothing while the other is alive.
+    NACKs and retransmits are sent from own timer thread, never from the
+    channel reading thread.
+*/
+class RetransmitLink : public Communicator
+{
+public:
+    /*  @param otp communicator of OTP processor (incoming clusters)
+        @param tunnel communicator of SSL tunnel (outgoing clusters)
+        @param storeSize in Kb
+    */
+    RetransmitLink( Communicator* otp,
+                    Communicator* tunnel,
+                    NotificationsMgrBase* notifier,
+                    u32 storeSize = DEF_RETRANSMIT_STORE_SIZE );
+    virtual ~RetransmitLink();
+
+    /*  OTP_Module: outgoing clusters, SSL channels: incoming ones */
+    virtual u32 do_perform( const RawMessage& msg, SenderType type );
+
+    virtual SenderType get_type( void )
+    { return Communicator::OTP_Module; }
+
+    /*  Testing: drops outgoing clusters with the given probability
+        (they are stored and can be retransmitted)
+        @param permille drop probability in 1/1000
+    */
+    inline void setDropRate( u32 permille )
+    { dropRate_ = permille; }
+
+    /*  Enables FEC parity, the bandwidth overhead is 1/K
+        @param groupSize K data clusters per parity, 0 - FEC is off
+    */
+    void setFecGroup( u32 groupSize );
+
+    /*  Number of SSL channels of tunnel (see Communicator::channelType) */
+    inline void setChannelsNum( u32 channels )
+    {
+        assert( (channels >= 1 && channels <= MAX_SSL_CHANNELS) && "RetransmitLink::setChannelsNum Invalid channels number!" );
+        interlockedStore32( &channels_, channels );
+    }
+
+    /*  Outgoing clusters without explicit channel are assigned to the channel
+        with the lowest expected delivery time (see SSL_Tunnel::scheduleChannel),
+        should be used before start of traffic
+        @param tunnel NULL - send methods are passed to the tunnel as is
+    */
+    inline void setChannelScheduling( SSL_Tunnel* tunnel )
+    { schedulingTunnel_ = tunnel; }
+
+    /*  Sends every outgoing cluster over all channels (Redundant send method)
+        trading the bandwidth for the latency of the slower channel
+    */
+    inline void setRedundant( bool redundant )
+    { redundant_ = redundant; }
+
+    inline u64 getNacksSent( void ) const
+    { return (u64)interlockedLoad64(&nacksSent_); }
+
+    inline u64 getRetransmitted( void ) const
+    { return (u64)interlockedLoad64(&retransmitted_); }
+
+    inline u64 getDropped( void ) const
+    { return (u64)interlockedLoad64(&dropped_); }
+
+    inline u64 getDuplicates( void ) const
+    { return (u64)interlockedLoad64(&duplicates_); }
+
+    inline u64 getRebuilt( void ) const
+    { MGuard guard( lock_ ); return fecDecoder_.getRebuilt(); }
+
+private:
+    /*  Sends due NACKs and requested retransmits */
+    class SendTimer : public WheelTimer {
+    public:
+        explicit SendTimer( RetransmitLink* owner )
+            : owner_(owner)
+        {}
+
+        virtual ~SendTimer()
+        { owner_->wheel_.cancel( this ); }
+
+    protected:
+        virtual void expired( void )
+        { owner_->onTimer(); }
+    private:
+        RetransmitLink* owner_;
+    };
+    friend class SendTimer;
+
+    struct Resend {
+        ClusterIdRange range;
+        Cluster::SendMethod method;
+    };
+
+    u32 onOutgoing( const RawMessage& msg );
+    u32 onIncoming( const RawMessage& msg, SenderType type );
+    void onNack( const u8* data, u32 len, SenderType type );
+    void onControl( const u8* data, u32 len, SenderType type, std::vector<u8>* rebuilt );
+    void onTimer( void );
+
+    /*  Re-arms timer to the earliest work, lock_ is held */
+    void schedule( u64 now );
+
+    void send( const u8* cluster, u32 size, Cluster::SendMethod method );
+
+    /*  The channel next to the given one, resends and control messages
+        avoid the channel where the cluster was lost */
+    Cluster::SendMethod otherChannel( Cluster::SendMethod method ) const;
+
+    /*  Testing: outgoing cluster should be dropped (counted) */
+    bool isDropped( void );
+
+    /*  Length of cluster frame at the buffer or 0 if data isn't framed clusters */
+    static u32 frameLength( const u8* data, u32 len );
+
+    Communicator* otp_;
+    Communicator* tunnel_;
+    SSL_Tunnel* schedulingTunnel_;
+    NotificationsMgrBase* notifier_;
+
+    mutable Mutex lock_;        /* store, tracker, FEC and resends */
+    Mutex sendLock_;            /* tunnel sending */
+    RetransmitStore store_;
+    NackTracker tracker_;
+    std::vector<Resend> resends_;
+    FecEncoder fecEncoder_;
+    FecDecoder fecDecoder_;
+    DuplicateFilter arrived_;
+    Cluster::SendMethod lastChannel_;
+    volatile u32 channels_;
+
+    TimingWheel wheel_;
+    SendTimer timer_;
+
+    volatile bool redundant_;
+    u32 dropRate_;
+    u32 dropSeed_;
+    volatile i64 nacksSent_;
+    volatile i64 retransmitted_;
+    volatile i64 dropped_;
+    volatile i64 duplicates_;
+};
+
+/**/
+#endif /* __retransmit_link_h__ */
@@ -0,0 +1,164 @@
+#ifndef __spsc_ring_h__
+#define __spsc_ring_h__
+
+#include "interlocked.h"
+
+#include <cassert>
+#include <vector>
+
+#define SPSC_CACHE_LINE_SIZE    64
+
+/*******************************************************/
+/*  Bounded lock-free ring for exactly one producer thread and one consumer thread.
+    Capacity is rounded up to the power of two, head and tail are free-running
+    counters masked on access, so the ring is full when (tail - head) == capacity.
+    Producer owns tail_, consumer owns head_, each one is placed in its own cache line.
+    @note T should be default constructible and assignable. Slots are allocated once
+    at construction and reused, so pushing of T doesn't touch the heap when T
+    reuses own storage on assignment.
+*/
+template<typename T>
+class SpscRing
+{
+public:
+    /*  @param capacity number of slots (rounded up to power of two, 2 at least) */
+    explicit SpscRing( u32 capacity );
+
+    /*  Producer side. Copies item to the next free slot.
+        @returns false when ring is full
+    */
+    inline bool push( const T& item );
+
+    /*  Consumer side. Returns the oldest item or NULL when ring is empty.
+        @note item is valid until pop() is called
+    */
+    inline T* front( void );
+
+    /*  Consumer side. Returns the oldest items which are placed contiguously in ring
+        (till the wrap of slots array) or NULL when ring is empty.
+        @param count receives the number of items, limited by maxCount
+        @note items are valid until pop(n) is called
+    */
+    inline T* frontSpan( u32* count, u32 maxCount );
+
+    /*  Consumer side. Releases the slot returned by front() */
+    inline void pop( void );
+
+    /*  Consumer side. Releases n slots returned by frontSpan() */
+    inline void pop( u32 n );
+
+    /*  Both sides. Approximate state when called from the third thread */
+    inline bool empty( void ) const;
+    inline bool full( void ) const;
+    inline u32  size( void ) const;
+
+    inline u32 capacity( void ) const
+    { return mask_ + 1; }
+
+private:
+    SpscRing( const SpscRing& );
+    SpscRing& operator=( const SpscRing& );
+
+    static u32 roundUpPow2( u32 n );
+
+    std::vector<T> slots_;
+    u32 mask_;
+
+    u8 pad0_[SPSC_CACHE_LINE_SIZE];
+    volatile u32 head_;     /* written by consumer only */
+    u8 pad1_[SPSC_CACHE_LINE_SIZE - sizeof(u32)];
+    volatile u32 tail_;     /* written by producer only */
+    u8 pad2_[SPSC_CACHE_LINE_SIZE - sizeof(u32)];
+};
+
+/*******************************************************/
+template<typename T>
+SpscRing<T>::SpscRing( u32 capacity )
+    : mask_( roundUpPow2(capacity < 2 ? 2 : capacity) - 1 ),
+    head_(0),
+    tail_(0)
+{
+    slots_.resize( mask_ + 1 );
+}
+
+template<typename T>
+u32 SpscRing<T>::roundUpPow2( u32 n )
+{
+    assert( (n <= 0x80000000) && "SpscRing::roundUpPow2 Capacity is too large!" );
+    --n;
+    n |= n >> 1;
+    n |= n >> 2;
+    n |= n >> 4;
+    n |= n >> 8;
+    n |= n >> 16;
+    return n + 1;
+}
+
+template<typename T>
+inline bool SpscRing<T>::push( const T& item )
+{
+    u32 tail = tail_;
+    if( tail - interlockedLoad32(&head_) > mask_ )
+        return false;
+
+    slots_[tail & mask_] = item;
+    interlockedStore32( &tail_, tail + 1 );
+    return true;
+}
+
+template<typename T>
+inline T* SpscRing<T>::front( void )
+{
+    u32 head = head_;
+    if( head == interlockedLoad32(&tail_) )
+        return NULL;
+    return &slots_[head & mask_];
+}
+
+template<typename T>
+inline T* SpscRing<T>::frontSpan( u32* count, u32 maxCount )
+{
+    u32 head = head_;
+    u32 avail = interlockedLoad32(&tail_) - head;
+    u32 toWrap = (mask_ + 1) - (head & mask_);
+
+    if( avail > toWrap ) avail = toWrap;
+    if( avail > maxCount ) avail = maxCount;
+    *count = avail;
+    return avail ? &slots_[head & mask_] : NULL;
+}
+
+template<typename T>
+inline void SpscRing<T>::pop( void )
+{
+    u32 head = head_;
+    assert( (head != interlockedLoad32(&tail_)) && "SpscRing::pop Ring is empty!" );
+    interlockedStore32( &head_, head + 1 );
+}
+
+template<typename T>
+inline void SpscRing<T>::pop( u32 n )
+{
+    u32 head = head_;
+    assert( (interlockedLoad32(&tail_) - head >= n) && "SpscRing::pop Releasing more items than ring has!" );
+    interlockedStore32( &head_, head + n );
+}
+
+template<typename T>
+inline bool SpscRing<T>::empty( void ) const {
+    return interlockedLoad32(&head_) == interlockedLoad32(&tail_);
+}
+
+template<typename T>
+inline bool SpscRing<T>::full( void ) const {
+    return size() > mask_;
+}
+
+template<typename T>
+inline u32 SpscRing<T>::size( void ) const {
+    u32 head = interlockedLoad32(&head_);
+    return interlockedLoad32(&tail_) - head;
+}
+
+/**/
+#endif /* __spsc_ring_h__ */
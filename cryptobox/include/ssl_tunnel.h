@@ -5,6 +5,8 @@
 #include "ssl_server_adapter.h"
 #include "ssl_context.h"
 #include "enque_buffer_sender.h"
+#include "channel_scheduler.h"
+#include "timing_wheel.h"
 
 #include "ipaddress.h"
 #include "eventp.h"
@@ -44,8 +46,35 @@ public:
         return channelTwo_; 
     }
 
+    /*  @param index zero-based index of channel (see Communicator::channelType)
+        @returns connection of channel or NULL if it's not connected
+    */
+    inline CryptoConnection* channel( u32 index ) {
+        MGuard g(lock_);
+        if( index < 2 )
+            return index ? channelTwo_ : channelOne_;
+        return (index - 2 < extraChannels_.size()) ? extraChannels_[index - 2] : NULL;
+    }
+
+    /*  Number of channels set by setChannelsNum,
+        ChannelOne and ChannelTwo are always there */
+    inline u32 channelsNum( void ) const {
+        MGuard g(lock_);
+        return 2 + (u32)extraChannels_.size();
+    }
+
+    inline void setChannelsNum( u32 num ) {
+        assert( (num >= 2 && num <= MAX_SSL_CHANNELS) && "ChannelObserver::setChannelsNum Invalid channels number!" );
+        MGuard g(lock_);
+        extraChannels_.resize( num - 2, NULL );
+    }
+
     bool isReady( void ) const { 
         MGuard g(lock_);
+        for( size_t i = 0; i < extraChannels_.size(); ++i ) {
+            if( extraChannels_[i] == NULL )
+                return false;
+        }
         return (channelOne_ && channelTwo_); 
     }
 
@@ -81,6 +110,7 @@ private:
     Event channelWaiter_;
     CryptoConnection* channelOne_;
     CryptoConnection* channelTwo_;
+    std::vector<CryptoConnection*> extraChannels_;  /* the third and next channels, NULL - not connected */
 
     EnqueBufferSender* comm_;
 
@@ -149,6 +179,15 @@ public:
 
     void shutdown(void);
 
+    /*  Resolves Undefined, Random and Different send methods of cluster
+        to the channel with the lowest expected delivery time, so clusters are
+        striped across all channels by their capacity.
+        RetransmitLink calls it before do_perform (see setChannelScheduling)
+        @returns channel send method, or the own method of cluster
+        if channel is set explicitly or channels state is unknown
+    */
+    inline Cluster::SendMethod scheduleChannel( const Cluster& cluster );
+
 protected:
     /*  Synchronous connection 
         @returns true if connection succes
@@ -170,7 +209,38 @@ private:
     SSLConnectionAdapter* pClient_;
     Mutex lock_;
     bool shutdown_;
+
+    ChannelScheduler scheduler_;
 };
 
+inline Cluster::SendMethod SSL_Tunnel::scheduleChannel( const Cluster& cluster )
+{
+    Cluster::SendMethod method = cluster.get_send_method();
+    if( Cluster::channelIndex(method) >= 0 || method == Cluster::Redundant )
+        return method;
+
+    u64 now = TimingWheel::monotonicUs();
+    /*  the only claimer samples channels, the others select by the previous sample */
+    if( scheduler_.claimSample(now) )
+    {
+        u32 channels = observer_->channelsNum();
+        for( u32 i = 0; i < channels; ++i ) {
+            Cluster::SendMethod channel = Cluster::channelMethod( i );
+            CryptoConnection* connection = observer_->channel( i );
+            ChannelMetrics metrics;
+            if( connection == NULL ) {
+                scheduler_.update( channel, NULL );
+                continue;
+            }
+            /*  channel without TCP info is scheduled by the default estimate */
+            ChannelScheduler::sample( connection->get_fd(), &metrics );
+            scheduler_.update( channel, &metrics );
+        }
+    }
+
+    Cluster::SendMethod selected = scheduler_.select( cluster.size() );
+    return (selected != Cluster::Undefined) ? selected : method;
+}
+
 /**/
 #endif /* __ssl_tunnel_h__ */
@@ -0,0 +1,163 @@
+#ifndef __timing_wheel_h__
+#define __timing_wheel_h__
+
+#include "common_defines.h"
+#include "thread.h"
+#include "eventp.h"
+#include "mutex.h"
+#include "interlocked.h"
+
+#include <cassert>
+#include <memory>
+
+/*******************************************************/
+#define DEF_TIMING_WHEEL_TICK       10      /* ms, deadlines resolution */
+#define TIMING_WHEEL_LEVEL_BITS     8       /* 256 slots per level */
+#define TIMING_WHEEL_LEVELS         4       /* 2^32 ticks range */
+
+class TimingWheel;
+
+/*******************************************************/
+/*  Deadline of timing wheel. The object is embedded into its owner
+    and linked into wheel slot on arming, so arming, re-arming and
+    cancelling don't allocate memory.
+    @note derived timer should cancel itself in its own destructor:
+    the running expiration calls expired() of the derived object
+*/
+class WheelTimer
+{
+    friend class TimingWheel;
+
+public:
+    WheelTimer();
+
+    /*  Asserts that deadline is cancelled by the derived destructor */
+    virtual ~WheelTimer();
+
+    inline bool isArmed( void ) const
+    { return pprev_ != NULL; }
+
+protected:
+    /*  Called from the wheel thread when deadline is expired,
+        the timer can be armed again from here
+    */
+    virtual void expired( void ) = 0;
+
+private:
+    WheelTimer( const WheelTimer& );
+    WheelTimer& operator=( const WheelTimer& );
+
+    WheelTimer*  next_;
+    WheelTimer** pprev_;    /* slot head or previous next_, NULL when disarmed */
+    u64 deadline_;          /* in ticks */
+    TimingWheel* wheel_;
+};
+
+/*******************************************************/
+/*  Hierarchical timing wheel (Varghese & Lauck).
+    Level 0 has a slot per tick, every next level has a slot per full turn
+    of the previous one, far deadlines are cascaded down on turns.
+    The wheel thread wakes up once per tick and expires all passed ticks
+    in one batch, expirations are called with the wheel lock released.
+*/
+class TimingWheel : public Thread
+{
+public:
+    /*  @param tick resolution in ms */
+    explicit TimingWheel( const std::string& name, u32 tick = DEF_TIMING_WHEEL_TICK );
+    virtual ~TimingWheel();
+
+    /*  Starts ticking thread */
+    virtual void start( void );
+
+    /*  Stops ticking thread, armed timers stay armed */
+    void shutdown( void );
+
+    /*  Arms timer to expire after delay or moves armed timer to the new deadline
+        @param delay in ms, rounded up to the tick
+    */
+    void arm( WheelTimer* timer, u32 delay );
+
+    /*  Disarms timer and waits for its expiration which is already running,
+        so the timer isn't used by the wheel after return
+        @returns false if timer was not armed (expired or never armed)
+        @note isn't waited when called from expired() of the timer itself
+    */
+    bool cancel( WheelTimer* timer );
+
+    /*  Expires deadlines passed till now, called by ticking thread
+        @returns number of expired timers
+    */
+    u32 advance( void );
+
+    /*  Monotonic clock in microseconds */
+    static u64 monotonicUs( void );
+
+    /*  Number of armed timers */
+    inline u32 getArmed( void ) const
+    { return (u32)interlockedLoad32(&armed_); }
+
+protected:
+    /* Thread::run implementation */
+    virtual void run( void );
+
+private:
+    enum {
+        SlotsNum  = 1 << TIMING_WHEEL_LEVEL_BITS,
+        SlotsMask = SlotsNum - 1
+    };
+
+    /*  Current time in ticks from the wheel creation */
+    u64 now( void ) const;
+
+    /*  Links timer into slot by its deadline, lock_ is held */
+    void link( WheelTimer* timer );
+    inline void linkTo( WheelTimer** head, WheelTimer* timer );
+    inline void unlink( WheelTimer* timer );
+
+    /*  Moves timers of the level slot down to lower levels, lock_ is held */
+    void cascade( u32 level, u32 index );
+
+    /*  Expiration of timer is over, wakes up cancel() waiting for it */
+    void expirationDone( void );
+
+    static u64 currentThreadId( void );
+
+    u32 tick_;
+    u64 origin_;        /* ms of monotonic clock */
+    u64 current_;       /* next tick to be processed */
+
+    WheelTimer* slots_[TIMING_WHEEL_LEVELS][SlotsNum];
+    WheelTimer* expired_;   /* batch of expired timers, can be cancelled yet */
+    WheelTimer* expiring_;  /* timer which expired() is running */
+    u64 expiringThread_;
+    u32 cancelWaiting_;
+
+    Mutex lock_;
+    std::auto_ptr<Event> stop_;
+    std::auto_ptr<Event> expirationDone_;
+    volatile u32 running_;
+    volatile u32 armed_;
+};
+
+inline void TimingWheel::unlink( WheelTimer* timer )
+{
+    assert( timer->pprev_ && "TimingWheel::unlink Timer is not armed!" );
+    *timer->pprev_ = timer->next_;
+    if( timer->next_ )
+        timer->next_->pprev_ = timer->pprev_;
+    timer->next_ = NULL;
+    timer->pprev_ = NULL;
+}
+
+inline void TimingWheel::linkTo( WheelTimer** head, WheelTimer* timer )
+{
+    timer->next_ = *head;
+    if( *head )
+        (*head)->pprev_ = &timer->next_;
+    *head = timer;
+    timer->pprev_ = head;
+}
+
+/**/
+#endif /* __timing_wheel_h__ */
@@ -0,0 +1,51 @@
+#ifndef __xor_kernel_h__
+#define __xor_kernel_h__
+
+#include "common_defines.h"
+
+/*******************************************************/
+/*  XOR of the data with OTP pad used by Cluster encoding and decoding.
+    Vectorized kernel is chosen at the first call by CPU features detection,
+    all kernels produce bit-exact output of the scalar one.
+*/
+class XorKernel
+{
+public:
+    enum Type {
+        Scalar  = 0,
+        SSE2    = 1,
+        AVX2    = 2,
+        AVX512  = 3,
+        TypesNum
+    };
+
+    /*  dst[i] = src[i] ^ pad[i], dst may be equal to src */
+    typedef void (*Func)( u8* dst, const u8* src, const u8* pad, u32 len );
+
+    /*  XOR by the selected kernel */
+    static inline void apply( u8* dst, const u8* src, const u8* pad, u32 len )
+    { current_( dst, src, pad, len ); }
+
+    /*  Best kernel supported by CPU and OS */
+    static Type detect( void );
+
+    /*  Forces the kernel (benchmarking or fallback)
+        @returns false when kernel is not supported by CPU
+    */
+    static bool select( Type type );
+
+    /*  @returns kernel function or NULL when kernel is not supported by CPU */
+    static Func get( Type type );
+
+    static Type selected( void );
+    static const char* name( Type type );
+
+private:
+    /*  first call dispatcher, replaces current_ by detected kernel */
+    static void dispatch( u8* dst, const u8* src, const u8* pad, u32 len );
+
+    static Func volatile current_;
+};
+
+/**/
+#endif /* __xor_kernel_h__ */
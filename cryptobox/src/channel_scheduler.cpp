@@ -0,0 +1,98 @@
+#include "channel_scheduler.h"
+
+#ifndef WIN32
+    #include <sys/ioctl.h>
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <linux/sockios.h>
+#endif
+
+/***********************************************************/
+ChannelScheduler::ChannelScheduler( u32 sampleInterval )
+    : sampleInterval_(sampleInterval),
+    sampledAt_(0)
+{}
+
+bool ChannelScheduler::sample( SD fd, ChannelMetrics* metrics )
+{
+#ifdef WIN32
+    (void)fd;
+    (void)metrics;
+    return false;
+#else
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if( getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) != 0 )
+        return false;
+
+    int queued = 0;
+    if( ioctl(fd, SIOCOUTQ, &queued) != 0 )
+        queued = 0;
+
+    metrics->rtt = info.tcpi_rtt;
+    metrics->rttVar = info.tcpi_rttvar;
+    metrics->window = info.tcpi_snd_cwnd * info.tcpi_snd_mss;
+    metrics->queued = (queued > 0) ? (u32)queued : 0;
+    return true;
+#endif
+}
+
+bool ChannelScheduler::claimSample( u64 now )
+{
+    MGuard guard( lock_ );
+    if( sampledAt_ != 0 && now - sampledAt_ < sampleInterval_ )
+        return false;
+    sampledAt_ = now;
+    return true;
+}
+
+void ChannelScheduler::update( Cluster::SendMethod channel, const ChannelMetrics* metrics )
+{
+    MGuard guard( lock_ );
+    u32 pos = index( channel );
+    if( pos >= channels_.size() )
+        channels_.resize( pos + 1 );
+    Channel& state = channels_[pos];
+    state.up = (metrics != NULL);
+    state.metrics = metrics ? *metrics : ChannelMetrics();
+}
+
+u64 ChannelScheduler::expectedDelivery( const Channel& channel, u32 size ) const
+{
+    /*  the variance is the margin for the unstable channel */
+    u64 rtt = channel.metrics.rtt ? channel.metrics.rtt + channel.metrics.rttVar : DEF_CHANNEL_RTT;
+    u64 window = channel.metrics.window ? channel.metrics.window : DEF_CHANNEL_WINDOW;
+    u64 queued = (u64)channel.metrics.queued + size;
+    return rtt / 2 + queued * rtt / window;
+}
+
+u64 ChannelScheduler::getExpectedDelivery( Cluster::SendMethod channel, u32 size ) const
+{
+    MGuard guard( lock_ );
+    u32 pos = index( channel );
+    return (pos < channels_.size()) ? expectedDelivery( channels_[pos], size ) : 0;
+}
+
+Cluster::SendMethod ChannelScheduler::select( u32 size )
+{
+    MGuard guard( lock_ );
+
+    u32 best = (u32)channels_.size();
+    u64 bestTime = 0;
+    for( u32 i = 0; i < channels_.size(); ++i ) {
+        if( !channels_[i].up )
+            continue;
+        u64 time = expectedDelivery( channels_[i], size );
+        if( best == channels_.size() || time < bestTime ) {
+            best = i;
+            bestTime = time;
+        }
+    }
+    if( best == channels_.size() )
+        return Cluster::Undefined;
+
+    /*  the cluster is in the queue till the next sample */
+    channels_[best].metrics.queued += size;
+    return Cluster::channelMethod( best );
+}
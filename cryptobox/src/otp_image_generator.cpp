@@ -0,0 +1,404 @@
+#include "otp_image_generator.h"
+#include "thread.h"
+#include "notifications_mgr_base.h"
+
+#include "openssl/evp.h"
+#include "openssl/rand.h"
+
+#ifndef WIN32
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <errno.h>
+#endif
+
+#define OTP_GEN_KEY_LEN     32
+#define OTP_GEN_IV_LEN      16
+
+/***********************************************************/
+class OtpImageGenerator::Worker : public Thread
+{
+public:
+    Worker( OtpImageGenerator* generator, const std::string& name )
+        : Thread(name),
+        generator_(generator)
+    {}
+
+protected:
+    virtual void run( void )
+    { generator_->work(); }
+
+private:
+    OtpImageGenerator* generator_;
+};
+
+/***********************************************************/
+#ifdef WIN32
+    #define INVALID_FILE INVALID_HANDLE_VALUE
+#else
+    #define INVALID_FILE (-1)
+#endif
+
+static std::string lastErrorText( void )
+{
+#ifdef WIN32
+    char buf[32];
+    sprintf( buf, "error %u", (u32)GetLastError() );
+    return buf;
+#else
+    return strerror(errno);
+#endif
+}
+
+static bool fileSize( const std::string& path, u64* size )
+{
+#ifdef WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if( !GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attr) )
+        return false;
+    *size = ((u64)attr.nFileSizeHigh << 32) | attr.nFileSizeLow;
+#else
+    struct stat st;
+    if( stat(path.c_str(), &st) == -1 )
+        return false;
+    *size = (u64)st.st_size;
+#endif
+    return true;
+}
+
+/***********************************************************/
+OtpImageGenerator::OtpImageGenerator( const std::string& path,
+                                      u32 imagesize,
+                                      NotificationsMgrBase* notifier )
+    : path_(path),
+    progressPath_(path + OTP_GEN_PROGRESS_SUFFIX),
+    notifier_(notifier),
+    imageBytes_((u64)imagesize << 20),
+    chunksNum_((u32)((imageBytes_ + DEF_OTP_GEN_CHUNK_SIZE - 1) / DEF_OTP_GEN_CHUNK_SIZE)),
+    image_(INVALID_FILE),
+    progress_(INVALID_FILE),
+    reportedPercent_(0),
+    nextChunk_(0),
+    cancelled_(0),
+    failed_(0),
+    doneBytes_(0)
+{
+    if( imagesize == 0 )
+        throw Exception("OTP image generation: image size should be defined");
+}
+
+OtpImageGenerator::~OtpImageGenerator()
+{
+    close();
+}
+
+bool OtpImageGenerator::isInterrupted( const std::string& path )
+{
+    u64 size = 0;
+    return fileSize(path, &size) && fileSize(path + OTP_GEN_PROGRESS_SUFFIX, &size);
+}
+
+void OtpImageGenerator::generate( u32 threads )
+{
+    if( threads == 0 )
+    {
+#ifdef WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo( &info );
+        threads = (u32)info.dwNumberOfProcessors;
+#else
+        long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+        threads = cpus > 0 ? (u32)cpus : 1;
+#endif
+    }
+    if( threads > chunksNum_ )
+        threads = chunksNum_;
+
+    bool resumed = prepare();
+    if( notifier_ ) {
+        char buf[128];
+        sprintf( buf, "%s OTP image %s: %u Mb by %u threads\n",
+            resumed ? "Resuming" : "Generating", path_.c_str(), (u32)(imageBytes_ >> 20), threads );
+        notifier_->notify( buf );
+    }
+
+    nextChunk_ = 0;
+    failed_ = 0;
+    cancelled_ = 0;
+
+    std::vector<Worker*> workers;
+    try {
+        for( u32 i = 0; i < threads; ++i ) {
+            char name[32];
+            sprintf( name, "OTP.Generator%u", i );
+            workers.push_back( new Worker(this, name) );
+            workers.back()->start();
+        }
+    }
+    catch( ... ) {
+        interlockedStore32( &failed_, 1 );
+        MGuard g(lock_);
+        if( error_.empty() )
+            error_ = "can't start worker thread";
+    }
+
+    for( std::vector<Worker*>::iterator It = workers.begin(); It != workers.end(); ++It ) {
+        (*It)->join();
+        delete *It;
+    }
+
+    if( interlockedLoad32(&failed_) ) {
+        close();
+        throw Exception("OTP image generation: " + error_);
+    }
+    if( interlockedLoad32(&cancelled_) ) {
+        close();
+        throw Exception("OTP image generation: cancelled, will be resumed from " + progressPath_);
+    }
+
+    close();
+#ifdef WIN32
+    DeleteFileA( progressPath_.c_str() );
+#else
+    unlink( progressPath_.c_str() );
+#endif
+    if( notifier_ )
+        notifier_->notify( "OTP image " + path_ + " is completed\n" );
+}
+
+bool OtpImageGenerator::prepare( void )
+{
+    u64 size = 0;
+    bool resumed = fileSize(path_, &size) && (size == imageBytes_) &&
+                   fileSize(progressPath_, &size) && (size == chunksNum_);
+
+    chunksDone_.assign( chunksNum_, 0 );
+    doneBytes_ = 0;
+    reportedPercent_ = 0;
+
+#ifdef WIN32
+    image_ = CreateFileA( path_.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                          resumed ? OPEN_EXISTING : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+    progress_ = CreateFileA( progressPath_.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                             resumed ? OPEN_EXISTING : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+#else
+    int flags = O_RDWR | O_CREAT | (resumed ? 0 : O_TRUNC);
+    image_ = open( path_.c_str(), flags, 0600 );
+    progress_ = open( progressPath_.c_str(), flags, 0600 );
+#endif
+    if( image_ == INVALID_FILE || progress_ == INVALID_FILE ) {
+        std::string reason = lastErrorText();
+        close();
+        throw Exception("OTP image generation: can't open " + path_ + " - " + reason);
+    }
+
+    if( resumed )
+    {
+#ifdef WIN32
+        DWORD rd = 0;
+        bool ok = ReadFile( progress_, &chunksDone_[0], chunksNum_, &rd, NULL ) && (rd == chunksNum_);
+#else
+        bool ok = pread( progress_, &chunksDone_[0], chunksNum_, 0 ) == (ssize_t)chunksNum_;
+#endif
+        if( !ok ) {
+            close();
+            throw Exception("OTP image generation: can't read " + progressPath_);
+        }
+
+        for( u32 chunk = 0; chunk < chunksNum_; ++chunk ) {
+            if( chunksDone_[chunk] ) {
+                u64 offset = (u64)chunk * DEF_OTP_GEN_CHUNK_SIZE;
+                doneBytes_ += (i64)(imageBytes_ - offset < DEF_OTP_GEN_CHUNK_SIZE ?
+                                    imageBytes_ - offset : DEF_OTP_GEN_CHUNK_SIZE);
+            }
+        }
+        u32 percent = (u32)(getDoneBytes() * 100 / imageBytes_);
+        reportedPercent_ = percent - percent % DEF_OTP_GEN_PROGRESS_STEP;
+        return true;
+    }
+
+    /*  preallocation keeps the image contiguous and fails early when disk is full */
+#ifdef WIN32
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG)imageBytes_;
+    bool allocated = SetFilePointerEx( image_, end, NULL, FILE_BEGIN ) && SetEndOfFile( image_ );
+#elif defined(__linux__)
+    bool allocated = (fallocate( image_, 0, 0, (off_t)imageBytes_ ) == 0) ||
+                     (posix_fallocate( image_, 0, (off_t)imageBytes_ ) == 0);
+#else
+    bool allocated = (posix_fallocate( image_, 0, (off_t)imageBytes_ ) == 0);
+#endif
+    if( !allocated ) {
+        std::string reason = lastErrorText();
+        close();
+        throw Exception("OTP image generation: can't allocate " + path_ + " - " + reason);
+    }
+
+    writeAt( progress_, 0, &chunksDone_[0], chunksNum_ );
+    flush( progress_ );
+    return false;
+}
+
+void OtpImageGenerator::close( void )
+{
+#ifdef WIN32
+    if( image_ != INVALID_FILE )
+        CloseHandle( image_ );
+    if( progress_ != INVALID_FILE )
+        CloseHandle( progress_ );
+#else
+    if( image_ != INVALID_FILE )
+        ::close( image_ );
+    if( progress_ != INVALID_FILE )
+        ::close( progress_ );
+#endif
+    image_ = INVALID_FILE;
+    progress_ = INVALID_FILE;
+}
+
+void OtpImageGenerator::work( void )
+{
+    u8* block = NULL;
+    try {
+#ifdef WIN32
+        block = (u8*)_aligned_malloc( DEF_OTP_GEN_BLOCK_SIZE, 0x1000 );
+#else
+        if( posix_memalign( (void**)&block, 0x1000, DEF_OTP_GEN_BLOCK_SIZE ) != 0 )
+            block = NULL;
+#endif
+        if( block == NULL )
+            throw Exception("no memory for generation block");
+
+        for(;;)
+        {
+            u32 chunk = interlockedAdd32( &nextChunk_, 1 ) - 1;
+            if( chunk >= chunksNum_ )
+                break;
+            if( chunksDone_[chunk] )
+                continue;
+
+            fillChunk( chunk, block );
+            if( interlockedLoad32(&cancelled_) || interlockedLoad32(&failed_) )
+                break;
+            completeChunk( chunk );
+        }
+    }
+    catch( const Exception& ex ) {
+        MGuard g(lock_);
+        if( error_.empty() )
+            error_ = ex.what();
+        interlockedStore32( &failed_, 1 );
+    }
+
+#ifdef WIN32
+    _aligned_free( block );
+#else
+    free( block );
+#endif
+}
+
+void OtpImageGenerator::fillChunk( u32 chunk, u8* block )
+{
+    u8 key[OTP_GEN_KEY_LEN];
+    u8 iv[OTP_GEN_IV_LEN];
+    if( RAND_bytes(key, sizeof(key)) != 1 || RAND_bytes(iv, sizeof(iv)) != 1 )
+        throw Exception("CSPRNG is not seeded");
+
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if( ctx == NULL || EVP_EncryptInit_ex(ctx, EVP_aes_256_ctr(), NULL, key, iv) != 1 ) {
+        EVP_CIPHER_CTX_free( ctx );
+        throw Exception("can't initialize AES-256-CTR keystream");
+    }
+    memset( key, 0, sizeof(key) );
+
+    u64 offset = (u64)chunk * DEF_OTP_GEN_CHUNK_SIZE;
+    u64 end = offset + DEF_OTP_GEN_CHUNK_SIZE;
+    if( end > imageBytes_ )
+        end = imageBytes_;
+
+    try {
+        for( ; offset < end; offset += DEF_OTP_GEN_BLOCK_SIZE )
+        {
+            if( interlockedLoad32(&cancelled_) || interlockedLoad32(&failed_) )
+                break;
+
+            u32 len = (u32)(end - offset < DEF_OTP_GEN_BLOCK_SIZE ? end - offset : DEF_OTP_GEN_BLOCK_SIZE);
+            int outLen = 0;
+
+            /*  keystream is the encryption of zeros */
+            memset( block, 0, len );
+            if( EVP_EncryptUpdate(ctx, block, &outLen, block, (int)len) != 1 || (u32)outLen != len )
+                throw Exception("AES-256-CTR keystream failure");
+
+            writeAt( image_, offset, block, len );
+            interlockedAdd64( &doneBytes_, len );
+            reportProgress();
+        }
+    }
+    catch( ... ) {
+        EVP_CIPHER_CTX_free( ctx );
+        throw;
+    }
+    EVP_CIPHER_CTX_free( ctx );
+}
+
+void OtpImageGenerator::completeChunk( u32 chunk )
+{
+    /*  chunk is marked only after its data is on disk */
+    flush( image_ );
+
+    MGuard g(lock_);
+    chunksDone_[chunk] = 1;
+    writeAt( progress_, chunk, &chunksDone_[chunk], 1 );
+}
+
+void OtpImageGenerator::reportProgress( void )
+{
+    if( notifier_ == NULL )
+        return;
+
+    u32 percent = (u32)(getDoneBytes() * 100 / imageBytes_);
+    MGuard g(lock_);
+    if( percent >= reportedPercent_ + DEF_OTP_GEN_PROGRESS_STEP ) {
+        reportedPercent_ = percent - percent % DEF_OTP_GEN_PROGRESS_STEP;
+        char buf[64];
+        sprintf( buf, "OTP image generation: %u%%\n", reportedPercent_ );
+        notifier_->notify( buf );
+    }
+}
+
+void OtpImageGenerator::writeAt( FileT fd, u64 offset, const u8* buf, u32 len )
+{
+    while( len )
+    {
+#ifdef WIN32
+        OVERLAPPED ov;
+        memset( &ov, 0, sizeof(ov) );
+        ov.Offset = (DWORD)offset;
+        ov.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD written = 0;
+        if( !WriteFile(fd, buf, len, &written, &ov) || written == 0 )
+            throw Exception("write failed - " + lastErrorText());
+#else
+        ssize_t written = pwrite( fd, buf, len, (off_t)offset );
+        if( written <= 0 ) {
+            if( written == -1 && errno == EINTR )
+                continue;
+            throw Exception("write failed - " + lastErrorText());
+        }
+#endif
+        buf += written;
+        offset += written;
+        len -= (u32)written;
+    }
+}
+
+void OtpImageGenerator::flush( FileT fd )
+{
+#ifdef WIN32
+    if( !FlushFileBuffers(fd) )
+#else
+    if( fdatasync(fd) == -1 )
+#endif
+        throw Exception("flush failed - " + lastErrorText());
+}
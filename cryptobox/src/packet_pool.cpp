@@ -0,0 +1,109 @@
+#include "packet_pool.h"
+
+#include <new>
+#include <cassert>
+#include <cstring>
+
+/***********************************************************/
+PacketBuffer::PacketBuffer( u32 capacity, u32 sizeClass )
+    : refs_(1),
+    capacity_(capacity),
+    sizeClass_(sizeClass),
+    reserved_(0)
+{}
+
+/***********************************************************/
+PacketPool& PacketPool::instance( void )
+{
+    static PacketPool pool;
+    return pool;
+}
+
+PacketPool::PacketPool()
+    : allocated_(0),
+    reused_(0)
+{
+    for( u32 i = 0; i < PACKET_POOL_CLASSES; ++i )
+        free_[i].reserve( DEF_PACKET_POOL_KEEP );
+}
+
+PacketPool::~PacketPool()
+{
+    for( u32 i = 0; i < PACKET_POOL_CLASSES; ++i )
+    {
+        for( FreeListT::iterator It = free_[i].begin(); It != free_[i].end(); ++It ) {
+            (*It)->~PacketBuffer();
+            ::operator delete( *It );
+        }
+        free_[i].clear();
+    }
+}
+
+u32 PacketPool::classBySize( u32 size )
+{
+    if( size <= PACKET_POOL_SMALL_SIZE )
+        return 0;
+    if( size <= PACKET_POOL_MEDIUM_SIZE )
+        return 1;
+    if( size <= PACKET_POOL_LARGE_SIZE )
+        return 2;
+    return PACKET_POOL_CLASSES;
+}
+
+u32 PacketPool::classCapacity( u32 sizeClass )
+{
+    static const u32 capacities[PACKET_POOL_CLASSES] = {
+        PACKET_POOL_SMALL_SIZE,
+        PACKET_POOL_MEDIUM_SIZE,
+        PACKET_POOL_LARGE_SIZE
+    };
+    assert( (sizeClass < PACKET_POOL_CLASSES) && "PacketPool::classCapacity Invalid size class!" );
+    return capacities[sizeClass];
+}
+
+PacketHandle PacketPool::acquire( u32 size )
+{
+    u32 sizeClass = classBySize( size );
+    if( sizeClass < PACKET_POOL_CLASSES )
+    {
+        MGuard g( lock_[sizeClass] );
+        FreeListT& freeList = free_[sizeClass];
+        if( !freeList.empty() )
+        {
+            PacketBuffer* buffer = freeList.back();
+            freeList.pop_back();
+            buffer->refs_ = 1;
+            interlockedAdd64( &reused_, 1 );
+            return PacketHandle( buffer );
+        }
+    }
+
+    u32 capacity = (sizeClass < PACKET_POOL_CLASSES) ? classCapacity(sizeClass) : size;
+    void* memory = ::operator new( sizeof(PacketBuffer) + capacity );
+    interlockedAdd64( &allocated_, 1 );
+    return PacketHandle( new(memory) PacketBuffer(capacity, sizeClass) );
+}
+
+PacketHandle PacketPool::acquire( const u8* srcBuf, u32 size )
+{
+    assert( srcBuf && size && "PacketPool::acquire <null> input data!" );
+
+    PacketHandle handle = acquire( size );
+    memcpy( handle->data(), srcBuf, size );
+    return handle;
+}
+
+void PacketPool::recycle( PacketBuffer* buffer )
+{
+    u32 sizeClass = buffer->sizeClass_;
+    if( sizeClass < PACKET_POOL_CLASSES )
+    {
+        MGuard g( lock_[sizeClass] );
+        if( free_[sizeClass].size() < DEF_PACKET_POOL_KEEP ) {
+            free_[sizeClass].push_back( buffer );
+            return;
+        }
+    }
+    buffer->~PacketBuffer();
+    ::operator delete( buffer );
+}
@@ -0,0 +1,70 @@
+#include "page_coalescer.h"
+#include "configuration.h"
+
+/***********************************************************/
+PageCoalescer::PageCoalescer( u32 latencyLimit )
+    : latencyLimit_(latencyLimit),
+    lastArrival_(0),
+    pageStart_(0),
+    meanGap_(0),
+    meanSize_(0)
+{}
+
+u64 PageCoalescer::getLimit() const
+{
+    return (u64)(latencyLimit_ ? latencyLimit_ : GV_OtpPageDeliveryTimelimit) * 1000;
+}
+
+u32 PageCoalescer::onPackage( u32 size, u32 pageFill, u32 queued, u64 now )
+{
+    u64 limitUs = getLimit();
+
+    /*  pauses longer than idle gap are counted as idle gap,
+        so the single pause doesn't hide the following burst */
+    u64 idleGap = limitUs * PAGE_IDLE_FACTOR;
+    u64 gap = lastArrival_ ? now - lastArrival_ : idleGap;
+    if( gap > idleGap )
+        gap = idleGap;
+    lastArrival_ = now;
+
+    if( meanGap_ == 0 && meanSize_ == 0 ) {
+        meanGap_ = gap;
+        meanSize_ = size;
+    }
+    else {
+        meanGap_ = meanGap_ - (meanGap_ >> PAGE_EWMA_SHIFT) + (gap >> PAGE_EWMA_SHIFT);
+        meanSize_ = meanSize_ - (meanSize_ >> PAGE_EWMA_SHIFT) + (size >> PAGE_EWMA_SHIFT);
+    }
+
+    /*  the first package of page starts its holding */
+    if( pageStart_ == 0 || pageFill <= size )
+        pageStart_ = now;
+
+    if( pageFill >= CLUSTER_DATALEN )
+        return 0;
+
+    u64 held = now - pageStart_;
+    if( held >= limitUs )
+        return 0;
+    u64 budget = limitUs - held;
+
+    /*  packages waiting in queue fill the page without waiting for arrivals,
+        the next of them re-arms the delivery */
+    if( queued )
+        return (budget < PAGE_QUEUED_DELAY * 1000) ? (u32)((budget + 999) / 1000) : PAGE_QUEUED_DELAY;
+
+    /*  idle link or sparse traffic which can't fill the page in time */
+    if( meanGap_ >= budget || meanSize_ == 0 )
+        return 0;
+
+    u64 missing = CLUSTER_DATALEN - pageFill;
+    u64 fillTime = (missing + meanSize_ - 1) / meanSize_ * meanGap_;
+    if( fillTime > budget )
+        return 0;
+
+    /*  the half of mean gap is the margin for arrival jitter */
+    u64 delay = fillTime + (meanGap_ >> 1);
+    if( delay > budget )
+        delay = budget;
+    return (u32)((delay + 999) / 1000);
+}
@@ -0,0 +1,707 @@
+#include "retransmit_link.h"
+#include "ssl_tunnel.h"
+#include "notifications_mgr_base.h"
+#include "useful.h"
+#include "xor_kernel.h"
+
+#include <cstring>
+#include <algorithm>
+
+#define RETRANSMIT_TIMER_THREADNAME     "rtxtimer"
+#define RETRANSMIT_TIMER_TICK           1           /* ms */
+#define NACK_RESYNC_DISTANCE            ((u64)DEF_REORDER_WINDOW << CLUSTER_ID_ORDER_BITS)
+
+/***********************************************************/
+/*  Fields of wire frames aren't aligned, they are copied by memcpy */
+template<typename T>
+static inline T loadField( const u8* data )
+{
+    T value;
+    memcpy( &value, data, sizeof(T) );
+    return value;
+}
+
+template<typename T>
+static inline void storeField( u8* data, T value )
+{
+    memcpy( data, &value, sizeof(T) );
+}
+
+/***********************************************************/
+static inline Cluster::SendMethod arrivalChannel( Communicator::SenderType type )
+{
+    i32 index = Communicator::channelIndex( type );
+    return Cluster::channelMethod( (index >= 0) ? (u32)index : 0 );
+}
+
+/***********************************************************/
+RetransmitStore::RetransmitStore( u32 maxSize )
+    : maxBytes_((u64)maxSize << 10),
+    bytes_(0)
+{}
+
+void RetransmitStore::store( u64 id, const u8* cluster, u32 size, Cluster::SendMethod method )
+{
+    ReorderRing<Entry>::iterator It = clusters_.find( id );
+    if( It != clusters_.end() ) {
+        /*  the same id is sent again after image rewind */
+        bytes_ -= It->second.size;
+        It->second.packet.reset();
+        clusters_.erase( It );
+    }
+
+    Entry entry;
+    entry.packet = PacketPool::instance().acquire( cluster, size );
+    entry.size = size;
+    entry.method = method;
+    clusters_.insert( std::make_pair(id, entry) );
+    bytes_ += size;
+
+    while( bytes_ > maxBytes_ && !clusters_.empty() )
+    {
+        It = clusters_.begin();
+        bytes_ -= It->second.size;
+        It->second.packet.reset();      /* slot storage is reused later */
+        clusters_.erase( It );
+    }
+}
+
+u32 RetransmitStore::fetch( const ClusterIdRange& range, std::vector<Entry>* out ) const
+{
+    u32 count = 0;
+    ReorderRing<Entry>::iterator It = clusters_.lower_bound( range.from );
+    for( ; It != clusters_.end() && It->first < range.to; ++It ) {
+        out->push_back( It->second );
+        ++count;
+    }
+    return count;
+}
+
+/***********************************************************/
+NackTracker::NackTracker()
+    : expected_(0),
+    srtt_(0)
+{}
+
+void NackTracker::addGap( u64 from, u64 to, u64 due )
+{
+    if( from >= to )
+        return;
+
+    Gap gap;
+    gap.range.from = from;
+    gap.range.to = to;
+    gap.due = due;
+    gap.sent = 0;
+    gap.tries = 0;
+    gaps_.push_back( gap );
+}
+
+u64 NackTracker::retryInterval( u32 tries ) const
+{
+    u64 interval = srtt_ * 2;
+    if( interval < DEF_NACK_MIN_RETRY * 1000 )
+        interval = DEF_NACK_MIN_RETRY * 1000;
+    return interval << (tries ? tries - 1 : 0);
+}
+
+bool NackTracker::onCluster( u64 id, bool endOfCluster, u64 now )
+{
+    u64 next = endOfCluster ?
+        Cluster::makeClusterIdFromNum( Cluster::makeClusterNumFromId(id) + 1 ) : id + 1;
+
+    if( expected_ == 0 || id == expected_ ) {
+        expected_ = next;
+        return true;
+    }
+
+    if( id > expected_ )
+    {
+        if( id - expected_ > NACK_RESYNC_DISTANCE )
+            gaps_.clear();      /* peer was repositioned */
+        else
+            addGap( expected_, id, now + DEF_NACK_REORDER_DELAY * 1000 );
+        expected_ = next;
+        return true;
+    }
+
+    for( GapsT::iterator It = gaps_.begin(); It != gaps_.end(); ++It )
+    {
+        if( id < It->range.from || id >= It->range.to )
+            continue;
+
+        /*  Karn: RTT only from the answer to the single NACK */
+        if( It->tries == 1 ) {
+            u64 sample = now - It->sent;
+            srtt_ = srtt_ ? srtt_ - (srtt_ >> 3) + (sample >> 3) : sample;
+        }
+
+        Gap tail = *It;
+        tail.range.from = next;
+        It->range.to = id;
+        if( It->range.from >= It->range.to )
+            gaps_.erase( It );
+        if( tail.range.from < tail.range.to )
+            gaps_.push_back( tail );
+        return true;
+    }
+
+    if( expected_ - id > NACK_RESYNC_DISTANCE ) {
+        /*  image rewind on the peer side */
+        gaps_.clear();
+        expected_ = next;
+        return true;
+    }
+    return false;
+}
+
+u64 NackTracker::collect( u64 now, ClusterIdRangesT* out )
+{
+    u64 nextDue = 0;
+    for( size_t i = 0; i < gaps_.size(); )
+    {
+        Gap& gap = gaps_[i];
+        if( gap.due <= now )
+        {
+            if( gap.tries >= DEF_NACK_RETRIES ) {
+                gaps_.erase( gaps_.begin() + i );
+                continue;
+            }
+            if( out->size() < MAX_NACK_RANGES ) {
+                out->push_back( gap.range );
+                ++gap.tries;
+                gap.sent = now;
+                gap.due = now + retryInterval( gap.tries );
+            }
+        }
+        if( nextDue == 0 || gap.due < nextDue )
+            nextDue = gap.due;
+        ++i;
+    }
+    return nextDue;
+}
+
+u64 NackTracker::nextDue() const
+{
+    u64 nextDue = 0;
+    for( size_t i = 0; i < gaps_.size(); ++i ) {
+        if( nextDue == 0 || gaps_[i].due < nextDue )
+            nextDue = gaps_[i].due;
+    }
+    return nextDue;
+}
+
+/***********************************************************/
+FecEncoder::FecEncoder( u32 groupSize )
+    : groupSize_(0)
+{
+    setGroupSize( groupSize );
+}
+
+void FecEncoder::setGroupSize( u32 groupSize )
+{
+    groupSize_ = (groupSize > MAX_FEC_GROUP_SIZE) ? MAX_FEC_GROUP_SIZE : groupSize;
+    reset();
+}
+
+void FecEncoder::reset()
+{
+    ids_.clear();
+    xorChunk_ = 0;
+    xorUsed_ = 0;
+    dataLen_ = 0;
+    memset( acc_, 0, sizeof(acc_) );
+}
+
+u32 FecEncoder::add( const u8* frame, u32 len, std::vector<u8>* parity )
+{
+    if( groupSize_ == 0 )
+        return 0;
+
+    u32 used = len - OTP_HEADER_LEN;
+    ids_.push_back( loadField<u64>( frame ) );
+    xorChunk_ ^= loadField<u16>( frame + OTP_CHUNKID_OFFSET );
+    xorUsed_ ^= used;
+    XorKernel::apply( acc_, acc_, frame + OTP_HEADER_LEN, used );
+    if( used > dataLen_ )
+        dataLen_ = used;
+
+    if( ids_.size() < groupSize_ )
+        return 0;
+
+    /*  u16 type, u16 count, u16 data length, u16 offset, ids, u16 chunks, u32 lengths */
+    u32 descLen = 8 + (u32)ids_.size() * 8 + 6;
+    u32 frames = 0;
+    for( u32 offset = 0; offset < dataLen_ || frames == 0; offset += FEC_STRIPE_SIZE )
+    {
+        u32 stripe = dataLen_ - offset;
+        if( stripe > FEC_STRIPE_SIZE )
+            stripe = FEC_STRIPE_SIZE;
+
+        size_t start = parity->size();
+        parity->resize( start + OTP_HEADER_LEN + descLen + stripe, 0 );
+        u8* out = &(*parity)[start];
+
+        storeField<u64>( out, CONTROL_CLUSTER_ID );
+        storeField<u32>( out + OTP_USEDLEN_OFFSET, descLen + stripe );
+        out += OTP_HEADER_LEN;
+
+        storeField<u16>( out, CONTROL_PARITY );
+        storeField<u16>( out + 2, (u16)ids_.size() );
+        storeField<u16>( out + 4, (u16)dataLen_ );
+        storeField<u16>( out + 6, (u16)offset );
+        memcpy( out + 8, &ids_[0], ids_.size() * 8 );
+        out += 8 + ids_.size() * 8;
+        memcpy( out, &xorChunk_, 2 );
+        memcpy( out + 2, &xorUsed_, 4 );
+        memcpy( out + 6, acc_ + offset, stripe );
+        ++frames;
+    }
+
+    reset();
+    return frames;
+}
+
+/***********************************************************/
+FecDecoder::FecDecoder( u32 historySize )
+    : history_(historySize),
+    active_(false),
+    rebuilt_(0)
+{}
+
+void FecDecoder::onData( u64 id, const u8* frame, u32 len, std::vector<u8>* rebuilt )
+{
+    if( !active_ )
+        return;
+
+    history_.store( id, frame, len, Cluster::Undefined );
+    for( GroupsT::iterator It = groups_.begin(); It != groups_.end(); )
+    {
+        bool member = std::find( It->ids.begin(), It->ids.end(), id ) != It->ids.end();
+        if( member && tryRebuild(*It, rebuilt) )
+            It = groups_.erase( It );
+        else
+            ++It;
+    }
+}
+
+void FecDecoder::onParity( const u8* data, u32 len, std::vector<u8>* rebuilt )
+{
+    if( len < 8 )
+        return;
+    u32 count = loadField<u16>( data + 2 );
+    u32 dataLen = loadField<u16>( data + 4 );
+    u32 offset = loadField<u16>( data + 6 );
+    u32 descLen = 8 + count * 8 + 6;
+    if( count == 0 || count > MAX_FEC_GROUP_SIZE || dataLen > CLUSTER_DATALEN ||
+        descLen > len || offset + (len - descLen) > CLUSTER_DATALEN || offset % FEC_STRIPE_SIZE )
+        return;
+
+    active_ = true;
+    u64 first;
+    memcpy( &first, data + 8, 8 );
+
+    GroupsT::iterator It = groups_.begin();
+    for( ; It != groups_.end(); ++It ) {
+        if( It->ids[0] == first && It->ids.size() == count )
+            break;
+    }
+    if( It == groups_.end() )
+    {
+        if( groups_.size() >= DEF_FEC_PENDING_GROUPS )
+            groups_.pop_front();
+        It = groups_.insert( groups_.end(), Group() );
+        It->ids.resize( count );
+        memcpy( &It->ids[0], data + 8, count * 8 );
+        It->dataLen = dataLen;
+        It->stripes = 0;
+        memcpy( &It->xorChunk, data + 8 + count * 8, 2 );
+        memcpy( &It->xorUsed, data + 8 + count * 8 + 2, 4 );
+        memset( It->parity, 0, sizeof(It->parity) );
+    }
+
+    memcpy( It->parity + offset, data + descLen, len - descLen );
+    It->stripes |= 1 << (offset / FEC_STRIPE_SIZE);
+    if( tryRebuild(*It, rebuilt) )
+        groups_.erase( It );
+}
+
+bool FecDecoder::tryRebuild( const Group& group, std::vector<u8>* rebuilt )
+{
+    u32 stripesNum = group.dataLen ? (group.dataLen + FEC_STRIPE_SIZE - 1) / FEC_STRIPE_SIZE : 1;
+    if( group.stripes != ((1u << stripesNum) - 1) )
+        return false;
+
+    std::vector<RetransmitStore::Entry> members;
+    u64 missed = 0;
+    u32 missedNum = 0;
+    for( size_t i = 0; i < group.ids.size(); ++i ) {
+        ClusterIdRange range = { group.ids[i], group.ids[i] + 1 };
+        if( history_.fetch(range, &members) == 0 ) {
+            missed = group.ids[i];
+            ++missedNum;
+        }
+    }
+    if( missedNum != 1 )
+        return missedNum == 0;
+
+    u8 frame[OTP_HEADER_LEN + CLUSTER_DATALEN];
+    u16 chunk = group.xorChunk;
+    u32 used = group.xorUsed;
+    memcpy( frame + OTP_HEADER_LEN, group.parity, group.dataLen );
+    for( size_t i = 0; i < members.size(); ++i ) {
+        const u8* member = members[i].packet->data();
+        u32 memberUsed = members[i].size - OTP_HEADER_LEN;
+        chunk ^= loadField<u16>( member + OTP_CHUNKID_OFFSET );
+        used ^= memberUsed;
+        if( memberUsed > group.dataLen )
+            return true;    /* inconsistent group, dropped */
+        XorKernel::apply( frame + OTP_HEADER_LEN, frame + OTP_HEADER_LEN, member + OTP_HEADER_LEN, memberUsed );
+    }
+    if( used > group.dataLen )
+        return true;
+
+    storeField<u64>( frame, missed );
+    storeField<u16>( frame + OTP_CHUNKID_OFFSET, chunk );
+    storeField<u32>( frame + OTP_USEDLEN_OFFSET, used );
+    rebuilt->insert( rebuilt->end(), frame, frame + OTP_HEADER_LEN + used );
+    history_.store( missed, frame, OTP_HEADER_LEN + used, Cluster::Undefined );
+    ++rebuilt_;
+    return true;
+}
+
+/***********************************************************/
+RetransmitLink::RetransmitLink( Communicator* otp,
+                                Communicator* tunnel,
+                                NotificationsMgrBase* notifier,
+                                u32 storeSize )
+    : otp_(otp),
+    tunnel_(tunnel),
+    schedulingTunnel_(NULL),
+    notifier_(notifier),
+    store_(storeSize),
+    lastChannel_(Cluster::ChannelOne),
+    channels_(2),
+    wheel_(RETRANSMIT_TIMER_THREADNAME, RETRANSMIT_TIMER_TICK),
+    timer_(this),
+    redundant_(false),
+    dropRate_(0),
+    dropSeed_(0x2545F491),
+    nacksSent_(0),
+    retransmitted_(0),
+    dropped_(0),
+    duplicates_(0)
+{
+    assert( otp_ && tunnel_ && "RetransmitLink::RetransmitLink Invalid communicators!" );
+    wheel_.start();
+}
+
+RetransmitLink::~RetransmitLink()
+{
+    wheel_.shutdown();
+    wheel_.cancel( &timer_ );
+}
+
+u32 RetransmitLink::frameLength( const u8* data, u32 len )
+{
+    if( len < OTP_HEADER_LEN )
+        return 0;
+    u32 used = loadField<u32>( data + OTP_USEDLEN_OFFSET );
+    if( used > CLUSTER_DATALEN || OTP_HEADER_LEN + used > len )
+        return 0;
+    return OTP_HEADER_LEN + used;
+}
+
+u32 RetransmitLink::do_perform( const RawMessage& msg, SenderType type )
+{
+    if( type == Communicator::OTP_Module )
+        return onOutgoing( msg );
+    return onIncoming( msg, type );
+}
+
+u32 RetransmitLink::onOutgoing( const RawMessage& msg )
+{
+    const Cluster& cluster = static_cast<const Cluster&>(msg);
+    const u8* data = msg.get();
+    u32 len = msg.size();
+
+    Cluster::SendMethod method = cluster.get_send_method();
+    if( redundant_ )
+        method = Cluster::Redundant;
+    else if( schedulingTunnel_ )
+        method = schedulingTunnel_->scheduleChannel( cluster );
+
+    std::vector<u8> parity;
+    {
+        MGuard guard( lock_ );
+        for( u32 pos = 0, frame = 0; pos < len; pos += frame ) {
+            frame = frameLength( data + pos, len - pos );
+            if( frame == 0 )
+                break;
+            u64 id = loadField<u64>( data + pos );
+            if( id & FIRST_ASSIGNED_CLUSTER_ID ) {
+                store_.store( id, data + pos, frame, method );
+                fecEncoder_.add( data + pos, frame, &parity );
+            }
+        }
+    }
+
+    u32 processed = len;
+    if( method == Cluster::Redundant ) {
+        /*  copies are dropped independently as on the separate links */
+        u32 channels = interlockedLoad32( &channels_ );
+        for( u32 i = 0; i < channels; ++i ) {
+            if( !isDropped() )
+                send( data, len, Cluster::channelMethod(i) );
+        }
+    }
+    else if( !isDropped() ) {
+        if( method != cluster.get_send_method() ) {
+            Cluster scheduled( cluster );
+            scheduled.set_send_method( method );
+            MGuard guard( sendLock_ );
+            processed = tunnel_->do_perform( scheduled, Communicator::OTP_Module );
+        }
+        else {
+            MGuard guard( sendLock_ );
+            processed = tunnel_->do_perform( msg, Communicator::OTP_Module );
+        }
+    }
+
+    /*  parity goes over the channel opposite to data (never dropped) */
+    for( u32 pos = 0, frame = 0; pos < parity.size(); pos += frame ) {
+        frame = frameLength( &parity[pos], (u32)parity.size() - pos );
+        send( &parity[pos], frame, otherChannel(method) );
+    }
+    return processed;
+}
+
+u32 RetransmitLink::onIncoming( const RawMessage& msg, SenderType type )
+{
+    const u8* data = msg.get();
+    u32 len = msg.size();
+    u64 now = TimingWheel::monotonicUs();
+
+    /*  not framed data is passed as is */
+    u32 pos = 0;
+    for( u32 frame = 0; pos < len; pos += frame ) {
+        frame = frameLength( data + pos, len - pos );
+        if( frame == 0 )
+            break;
+    }
+    if( pos != len )
+        return otp_->do_perform( msg, type );
+
+    /*  control messages and duplicates are cut out from the message */
+    RawMessage passed;
+    std::vector<u8> rebuilt;
+    bool filtered = false;
+    {
+        MGuard guard( lock_ );
+        lastChannel_ = arrivalChannel( type );
+
+        for( u32 frame = 0, pos = 0; pos < len; pos += frame )
+        {
+            frame = frameLength( data + pos, len - pos );
+            u64 id = loadField<u64>( data + pos );
+            bool pass = true;
+
+            if( id == CONTROL_CLUSTER_ID ) {
+                onControl( data + pos + OTP_HEADER_LEN, frame - OTP_HEADER_LEN, type, &rebuilt );
+                pass = false;
+            }
+            else if( id & FIRST_ASSIGNED_CLUSTER_ID ) {
+                u16 chunkId = loadField<u16>( data + pos + OTP_CHUNKID_OFFSET );
+                /*  image rewind on the peer side restarts the filter,
+                    the late copies behind its window are rejected as stale */
+                if( arrived_.behind(id) > NACK_RESYNC_DISTANCE )
+                    arrived_.reset();
+                /*  the copy of the other channel or retransmit after arrival */
+                pass = arrived_.check( id ) &&
+                       tracker_.onCluster( id, (chunkId & Cluster::EndOfCluster) != 0, now );
+                if( !pass )
+                    interlockedAdd64( &duplicates_, 1 );
+                else
+                    fecDecoder_.onData( id, data + pos, frame, &rebuilt );
+            }
+
+            if( !pass && !filtered ) {
+                passed.set( data, pos );
+                filtered = true;
+            }
+            else if( pass && filtered )
+                passed.add( data + pos, frame );
+        }
+
+        /*  rebuilt clusters close their gaps before NACKs */
+        for( u32 frame = 0, pos = 0; pos < rebuilt.size(); pos += frame )
+        {
+            const u8* cluster = &rebuilt[pos];
+            frame = frameLength( cluster, (u32)rebuilt.size() - pos );
+            u64 id = loadField<u64>( cluster );
+            u16 chunkId = loadField<u16>( cluster + OTP_CHUNKID_OFFSET );
+            if( !arrived_.check(id) ||
+                !tracker_.onCluster(id, (chunkId & Cluster::EndOfCluster) != 0, now) )
+                continue;
+            if( !filtered ) {
+                passed.set( data, len );
+                filtered = true;
+            }
+            passed.add( cluster, frame );
+        }
+        schedule( now );
+    }
+
+    if( !filtered )
+        return otp_->do_perform( msg, type );
+    if( passed.size() )
+        otp_->do_perform( passed, type );
+    return len;
+}
+
+Cluster::SendMethod RetransmitLink::otherChannel( Cluster::SendMethod method ) const
+{
+    i32 index = Cluster::channelIndex( method );
+    u32 channels = interlockedLoad32( &channels_ );
+    if( index < 0 || channels < 2 )
+        return Cluster::ChannelOne;
+    return Cluster::channelMethod( ((u32)index + 1) % channels );
+}
+
+bool RetransmitLink::isDropped()
+{
+    if( dropRate_ == 0 )
+        return false;
+
+    /*  xorshift, the same sequence for every run */
+    MGuard guard( sendLock_ );
+    dropSeed_ ^= dropSeed_ << 13;
+    dropSeed_ ^= dropSeed_ >> 17;
+    dropSeed_ ^= dropSeed_ << 5;
+    if( dropSeed_ % 1000 >= dropRate_ )
+        return false;
+    interlockedAdd64( &dropped_, 1 );
+    return true;
+}
+
+void RetransmitLink::setFecGroup( u32 groupSize )
+{
+    MGuard guard( lock_ );
+    fecEncoder_.setGroupSize( groupSize );
+}
+
+void RetransmitLink::onControl( const u8* data, u32 len, SenderType type, std::vector<u8>* rebuilt )
+{
+    if( len < 2 )
+        return;
+    switch( loadField<u16>( data ) )
+    {
+    case CONTROL_NACK:
+        onNack( data, len, type );
+        break;
+    case CONTROL_PARITY:
+        fecDecoder_.onParity( data, len, rebuilt );
+        break;
+    default:
+        break;
+    }
+}
+
+void RetransmitLink::onNack( const u8* data, u32 len, SenderType type )
+{
+    if( len < 4 )
+        return;
+
+    u32 count = loadField<u16>( data + 2 );
+    if( 4 + count * 16 > len )
+        return;
+
+    Cluster::SendMethod arrived = arrivalChannel( type );
+    for( u32 i = 0; i < count; ++i ) {
+        Resend resend;
+        memcpy( &resend.range.from, data + 4 + i * 16, 8 );
+        memcpy( &resend.range.to, data + 12 + i * 16, 8 );
+        resend.method = arrived;
+        resends_.push_back( resend );
+    }
+}
+
+void RetransmitLink::schedule( u64 now )
+{
+    if( !resends_.empty() ) {
+        wheel_.arm( &timer_, 0 );
+        return;
+    }
+
+    u64 due = tracker_.nextDue();
+    if( due == 0 )
+        return;
+    u32 delay = (due > now) ? (u32)((due - now + 999) / 1000) : 0;
+    wheel_.arm( &timer_, delay );
+}
+
+void RetransmitLink::onTimer()
+{
+    u64 now = TimingWheel::monotonicUs();
+    ClusterIdRangesT nacks;
+    std::vector<RetransmitStore::Entry> clusters;
+    std::vector<Cluster::SendMethod> methods;
+    Cluster::SendMethod nackMethod;
+
+    {
+        MGuard guard( lock_ );
+        for( size_t i = 0; i < resends_.size(); ++i ) {
+            u32 fetched = store_.fetch( resends_[i].range, &clusters );
+            for( u32 j = 0; j < fetched; ++j ) {
+                Cluster::SendMethod sent = clusters[clusters.size() - fetched + j].method;
+                if( Cluster::channelIndex(sent) < 0 )
+                    sent = resends_[i].method;
+                methods.push_back( otherChannel(sent) );
+            }
+        }
+        resends_.clear();
+
+        tracker_.collect( now, &nacks );
+        nackMethod = otherChannel( lastChannel_ );
+        schedule( now );
+    }
+
+    for( size_t i = 0; i < clusters.size(); ++i ) {
+        send( clusters[i].packet->data(), clusters[i].size, methods[i] );
+        interlockedAdd64( &retransmitted_, 1 );
+    }
+
+    if( !nacks.empty() )
+    {
+        u8 frame[OTP_HEADER_LEN + CLUSTER_DATALEN];
+        u32 used = 4 + (u32)nacks.size() * 16;
+        memset( frame, 0, OTP_HEADER_LEN );
+        storeField<u64>( frame, CONTROL_CLUSTER_ID );
+        storeField<u32>( frame + OTP_USEDLEN_OFFSET, used );
+        storeField<u16>( frame + OTP_HEADER_LEN, CONTROL_NACK );
+        storeField<u16>( frame + OTP_HEADER_LEN + 2, (u16)nacks.size() );
+        for( size_t i = 0; i < nacks.size(); ++i ) {
+            memcpy( frame + OTP_HEADER_LEN + 4 + i * 16, &nacks[i].from, 8 );
+            memcpy( frame + OTP_HEADER_LEN + 12 + i * 16, &nacks[i].to, 8 );
+        }
+        send( frame, OTP_HEADER_LEN + used, nackMethod );
+        interlockedAdd64( &nacksSent_, 1 );
+    }
+}
+
+void RetransmitLink::send( const u8* cluster, u32 size, Cluster::SendMethod method )
+{
+    try {
+        Cluster msg;
+        msg.reserve( size );
+        msg.set( cluster, (u16)size );
+        msg.set_send_method( method );
+
+        MGuard guard( sendLock_ );
+        tunnel_->do_perform( msg, Communicator::OTP_Module );
+    }
+    catch( const Exception& ex ) {
+        if( notifier_ )
+            notifier_->warning( std::string("Retransmit: ") + ex.what() + "\n" );
+    }
+}
@@ -0,0 +1,262 @@
+#include "enque_buffer_sender.h"
+#include "notifications_mgr_base.h"
+
+/***********************************************************/
+RingFifoBuffer::RingFifoBuffer( const std::string& bufferName,
+                                EnqueBufferSender* owner,
+                                u32 slots )
+    : FifoBuffer(bufferName, owner),
+    ring_(slots),
+    ringOwner_(owner),
+    running_(0),
+    processing_(0),
+    consumerWaiting_(0),
+    producerWaiting_(0),
+    flushWaiting_(0),
+    lowWatermark_(DEF_LOW_WATERMARK),
+    slotsLowWatermark_(0),
+    bytesLowWatermark_(0)
+{
+    readReady_.reset( new Event(false) );
+    writeReady_.reset( new Event(false) );
+    flushed_.reset( new Event(false) );
+    setLowWatermark( DEF_LOW_WATERMARK );
+}
+
+RingFifoBuffer::~RingFifoBuffer()
+{
+    if( !isStopped() )
+        shutdown();
+}
+
+void RingFifoBuffer::start()
+{
+    interlockedStore32( &processing_, 1 );
+    interlockedStore32( &running_, 1 );
+    Thread::start();
+}
+
+void RingFifoBuffer::shutdown()
+{
+    interlockedStore32( &running_, 0 );
+    interlockedFence();
+
+    /* release all sleepers */
+    readReady_->set();
+    writeReady_->set();
+    flushed_->set();
+    Thread::join();
+}
+
+void RingFifoBuffer::complete()
+{
+    sleepOn( flushed_.get(), &flushWaiting_, ForFlush, 0 );
+    interlockedStore32( &processing_, 0 );
+}
+
+void RingFifoBuffer::perform( bool processing )
+{
+    interlockedStore32( &processing_, processing ? 1 : 0 );
+    if( processing )
+        wakeup( readReady_.get(), &consumerWaiting_ );
+    else
+        wakeup( flushed_.get(), &flushWaiting_ );
+}
+
+bool RingFifoBuffer::isBufferReady() const
+{
+    if( !interlockedLoad32(&processing_) )
+        return false;
+    return ring_.empty() || isReadyToWrite(0);
+}
+
+void RingFifoBuffer::enqueue( const RawMessage& msg )
+{
+    if( isStopped() )
+        throw Exception(getName() + " - unable to enqueue message: ring buffer is not running");
+
+    /*  SpscRing::push isn't safe for concurrent producers */
+    MGuard guard( produceLock_ );
+
+    /*  usage is counted before publishing so the consumer never makes it negative */
+    interlockedAdd64( &bufferUsage_, (i64)msg.size() );
+    while( !ring_.push(msg) )
+    {
+        if( isStopped() ) {
+            interlockedAdd64( &bufferUsage_, -(i64)msg.size() );
+            throw Exception(getName() + " - unable to enqueue message: ring buffer goes to stopping");
+        }
+        sleepOn( writeReady_.get(), &producerWaiting_, ForSlot, 0 );
+    }
+    wakeup( readReady_.get(), &consumerWaiting_ );
+}
+
+bool RingFifoBuffer::waitReadyToWrite( u32 nBytes )
+{
+    while( !isReadyToWrite(nBytes) )
+    {
+        if( isStopped() )
+            return false;
+        sleepOn( writeReady_.get(), &producerWaiting_, ForWrite, nBytes );
+    }
+    return !isStopped();
+}
+
+void RingFifoBuffer::setBufferSize( u32 kb )
+{
+    bufferSize_ = ((i64)kb << 10);
+    interlockedStore64( &bytesLowWatermark_, bufferSize_ * lowWatermark_ / 100 );
+    wakeup( writeReady_.get(), &producerWaiting_ );
+}
+
+void RingFifoBuffer::setLowWatermark( u32 percent )
+{
+    if( percent == 0 || percent > 100 )
+        throw Exception(getName() + " - invalid low watermark, should be in range 1-100%");
+
+    lowWatermark_ = percent;
+    slotsLowWatermark_ = (u32)((u64)ring_.capacity() * percent / 100);
+    interlockedStore64( &bytesLowWatermark_, bufferSize_ * percent / 100 );
+    wakeup( writeReady_.get(), &producerWaiting_ );
+}
+
+bool RingFifoBuffer::isWaitOver( WaitFor what, u32 nBytes ) const
+{
+    if( isStopped() )
+        return true;
+
+    switch( what )
+    {
+    case ForRead:
+        return interlockedLoad32(&processing_) && !ring_.empty();
+    /*  hysteresis: producer stays blocked until consumer drains ring below
+        low watermark, so it is woken once per crossing instead of every dequeue */
+    case ForSlot:
+        return ring_.empty() || (isBelowLowWatermark() && !ring_.full());
+    case ForWrite:
+        return ring_.empty() || (isBelowLowWatermark() && isReadyToWrite(nBytes));
+    /*  paused consumer doesn't drain ring, there is nothing to wait for */
+    case ForFlush:
+        return ring_.empty() || !interlockedLoad32(&processing_);
+    }
+    assert( !"RingFifoBuffer::isWaitOver Invalid wait condition!" );
+    return true;
+}
+
+void RingFifoBuffer::sleepOn( Event* ev, volatile u32* waiting, WaitFor what, u32 nBytes )
+{
+    while( !isWaitOver(what, nBytes) )
+    {
+        ev->reset();
+        interlockedStore32( waiting, 1 );
+        interlockedFence();
+
+        /*  opposite side sees the flag or we see its changes (no lost wakeup) */
+        if( !isWaitOver(what, nBytes) )
+            ev->wait();
+        interlockedStore32( waiting, 0 );
+    }
+}
+
+void RingFifoBuffer::run()
+{
+    while( !isStopped() )
+    {
+        u32 count = 0;
+        RawMessage* msgs = NULL;
+        if( interlockedLoad32(&processing_) )
+            msgs = ring_.frontSpan( &count, RING_CONSUMER_BATCH );
+
+        if( msgs == NULL )
+        {
+            /*  short polling saves the event handoff under intensive traffic */
+            for( u32 spin = 0; (spin < RING_CONSUMER_SPIN) && ring_.empty(); ++spin ) {}
+
+            if( !isWaitOver(ForRead, 0) )
+                sleepOn( readReady_.get(), &consumerWaiting_, ForRead, 0 );
+            continue;
+        }
+
+        i64 size = 0;
+        for( u32 i = 0; i < count; ++i )
+            size += msgs[i].size();
+
+        /*  the callbacks take consumeLock_ as the owner's keepLock */
+        try {
+            if( count == 1 )
+                ringOwner_->on_message( *msgs, this, &consumeLock_ );
+            else
+                ringOwner_->on_message_batch( msgs, count, this, &consumeLock_ );
+        }
+        catch( const Exception& ex ) {
+            if( ringOwner_->notifier_ )
+                ringOwner_->notifier_->error( getName() + " - " + ex.what() + "\n" );
+        }
+
+        /*  slots keep their storage, pooled packets go back to the pool right now */
+        for( u32 i = 0; i < count; ++i )
+            msgs[i].detach();
+
+        interlockedAdd64( &bufferUsage_, -size );
+        ring_.pop( count );
+        interlockedAdd32( &messagesProcessed_, (i32)count );
+
+        bool empty = ring_.empty();
+        if( empty || isBelowLowWatermark() )
+            wakeup( writeReady_.get(), &producerWaiting_ );
+        if( empty )
+            wakeup( flushed_.get(), &flushWaiting_ );
+    }
+}
+
+/***********************************************************/
+bool EnqueBufferSender::on_message_batch( const RawMessage* msgs, 
+                                          u32 count, 
+                                          const FifoBuffer* self, 
+                                          Mutex* keepLock )
+{
+    assert( msgs && count && "EnqueBufferSender::on_message_batch <null> input data!" );
+
+    Communicator* comm = (self == incomingBuffer_.get()) ? inComm_ : outComm_;
+    if( comm == NULL )
+        return false;
+
+    /*  the lock is taken once for the whole batch instead of every message */
+    if( keepLock == NULL ) {
+        comm->do_perform_batch( msgs, count, senderType_ );
+        return true;
+    }
+
+    MGuard g(*keepLock);
+    comm->do_perform_batch( msgs, count, senderType_ );
+    return true;
+}
+
+/***********************************************************/
+bool EnqueBufferSender::setInRingMode( u32 slots )
+{
+    return switchToRing( incomingBuffer_, slots );
+}
+
+bool EnqueBufferSender::setOutRingMode( u32 slots )
+{
+    return switchToRing( outgoingBuffer_, slots );
+}
+
+bool EnqueBufferSender::switchToRing( std::auto_ptr<FifoBuffer>& buffer, u32 slots )
+{
+    assert( buffer.get() && "EnqueBufferSender::switchToRing <null> object ptr!" );
+
+    if( dynamic_cast<RingFifoBuffer*>(buffer.get()) )
+        return true;
+
+    try {
+        std::auto_ptr<FifoBuffer> ring( new RingFifoBuffer(buffer->getName(), this, slots) );
+        ring->setBufferSize( (u32)(buffer->getBufferSize() >> 10) );
+        buffer = ring;
+    }
+    catch( const std::bad_alloc& ) {
+        return false;
+    }
+    return true;
+}
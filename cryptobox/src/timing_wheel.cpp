@@ -0,0 +1,285 @@
+#include "timing_wheel.h"
+
+#ifdef WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+    #include <pthread.h>
+#endif
+
+#include <cstring>
+
+/***********************************************************/
+WheelTimer::WheelTimer()
+    : next_(NULL),
+    pprev_(NULL),
+    deadline_(0),
+    wheel_(NULL)
+{}
+
+WheelTimer::~WheelTimer()
+{
+    /*  expired() can't be called here, the derived object is destroyed already */
+    if( wheel_ && wheel_->cancel(this) )
+        assert( !"WheelTimer::~WheelTimer Timer should be cancelled by the derived destructor!" );
+}
+
+/***********************************************************/
+TimingWheel::TimingWheel( const std::string& name, u32 tick )
+    : Thread(name),
+    tick_(tick ? tick : 1),
+    origin_(monotonicUs() / 1000),
+    current_(0),
+    expired_(NULL),
+    expiring_(NULL),
+    expiringThread_(0),
+    cancelWaiting_(0),
+    running_(0),
+    armed_(0)
+{
+    memset( slots_, 0, sizeof(slots_) );
+    stop_.reset( new Event(false) );
+    expirationDone_.reset( new Event(false) );
+}
+
+TimingWheel::~TimingWheel()
+{
+    if( interlockedLoad32(&running_) )
+        shutdown();
+
+    /*  timers can outlive the wheel, they are detached */
+    MGuard guard( lock_ );
+    for( u32 level = 0; level < TIMING_WHEEL_LEVELS; ++level ) {
+        for( u32 index = 0; index < SlotsNum; ++index ) {
+            while( slots_[level][index] ) {
+                WheelTimer* timer = slots_[level][index];
+                unlink( timer );
+                timer->wheel_ = NULL;
+            }
+        }
+    }
+    while( expired_ ) {
+        WheelTimer* timer = expired_;
+        unlink( timer );
+        timer->wheel_ = NULL;
+    }
+}
+
+void TimingWheel::start()
+{
+    interlockedStore32( &running_, 1 );
+    stop_->reset();
+    Thread::start();
+}
+
+void TimingWheel::shutdown()
+{
+    interlockedStore32( &running_, 0 );
+    stop_->set();
+    Thread::join();
+}
+
+u64 TimingWheel::now() const
+{
+    return (monotonicUs() / 1000 - origin_) / tick_;
+}
+
+u64 TimingWheel::monotonicUs()
+{
+#ifdef WIN32
+    static LARGE_INTEGER freq = { 0 };
+    if( freq.QuadPart == 0 )
+        QueryPerformanceFrequency( &freq );
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter( &counter );
+    return (u64)(counter.QuadPart / freq.QuadPart) * 1000000 +
+           (u64)(counter.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (u64)ts.tv_sec * 1000000 + (u64)ts.tv_nsec / 1000;
+#endif
+}
+
+u64 TimingWheel::currentThreadId()
+{
+#ifdef WIN32
+    return (u64)GetCurrentThreadId();
+#else
+    return (u64)pthread_self();
+#endif
+}
+
+/***********************************************************/
+void TimingWheel::arm( WheelTimer* timer, u32 delay )
+{
+    assert( timer && "TimingWheel::arm Invalid timer!" );
+
+    MGuard guard( lock_ );
+    assert( (timer->wheel_ == NULL || timer->wheel_ == this) &&
+            "TimingWheel::arm Timer is armed in another wheel!" );
+
+    if( timer->isArmed() )
+        unlink( timer );
+    else
+        interlockedAdd32( &armed_, 1 );
+
+    /*  at least one full tick, current tick can be processed just now */
+    u64 ticks = ((u64)delay + tick_ - 1) / tick_;
+    u64 base = now();
+    if( base < current_ )
+        base = current_;
+
+    timer->deadline_ = base + (ticks ? ticks : 1);
+    timer->wheel_ = this;
+    link( timer );
+}
+
+bool TimingWheel::cancel( WheelTimer* timer )
+{
+    assert( timer && "TimingWheel::cancel Invalid timer!" );
+
+    for(;;)
+    {
+        {
+            MGuard guard( lock_ );
+            if( timer->isArmed() ) {
+                unlink( timer );
+                interlockedAdd32( &armed_, -1 );
+                return true;
+            }
+
+            /*  the timer cancelling itself from expired() isn't waited */
+            if( expiring_ != timer || expiringThread_ == currentThreadId() )
+                return false;
+            expirationDone_->reset();
+            ++cancelWaiting_;
+        }
+
+        /*  expired() can re-arm the timer, so the state is checked again */
+        expirationDone_->wait( tick_ );
+
+        MGuard guard( lock_ );
+        --cancelWaiting_;
+    }
+}
+
+void TimingWheel::link( WheelTimer* timer )
+{
+    u64 delta = (timer->deadline_ > current_) ? timer->deadline_ - current_ : 0;
+    u64 deadline = current_ + delta;
+
+    u32 level = 0;
+    while( level < TIMING_WHEEL_LEVELS - 1 &&
+           delta >= ((u64)1 << (TIMING_WHEEL_LEVEL_BITS * (level + 1))) )
+        ++level;
+
+    if( level == TIMING_WHEEL_LEVELS - 1 )
+    {
+        /*  longer deadlines wait in the last slot and are cascaded again */
+        u64 range = ((u64)1 << (TIMING_WHEEL_LEVEL_BITS * TIMING_WHEEL_LEVELS)) - 1;
+        if( delta > range )
+            deadline = current_ + range;
+    }
+
+    u32 index = (u32)(deadline >> (TIMING_WHEEL_LEVEL_BITS * level)) & SlotsMask;
+    linkTo( &slots_[level][index], timer );
+}
+
+void TimingWheel::cascade( u32 level, u32 index )
+{
+    WheelTimer* timer = slots_[level][index];
+    slots_[level][index] = NULL;
+
+    while( timer ) {
+        WheelTimer* next = timer->next_;
+        timer->next_ = NULL;
+        timer->pprev_ = NULL;
+        link( timer );
+        timer = next;
+    }
+}
+
+u32 TimingWheel::advance()
+{
+    u64 till = now();
+
+    {
+        MGuard guard( lock_ );
+        if( interlockedLoad32(&armed_) == 0 && current_ <= till )
+            current_ = till;    /* nothing to expire, skip idle ticks */
+
+        while( current_ <= till )
+        {
+            u32 index = (u32)current_ & SlotsMask;
+            if( index == 0 ) {
+                for( u32 level = 1; level < TIMING_WHEEL_LEVELS; ++level ) {
+                    u32 upper = (u32)(current_ >> (TIMING_WHEEL_LEVEL_BITS * level)) & SlotsMask;
+                    cascade( level, upper );
+                    if( upper != 0 )
+                        break;
+                }
+            }
+
+            while( slots_[0][index] ) {
+                WheelTimer* timer = slots_[0][index];
+                unlink( timer );
+                linkTo( &expired_, timer );
+            }
+            ++current_;
+        }
+    }
+
+    /*  the batch is taken one by one, so expired timer can be cancelled
+        or re-armed by another thread before its expiration is called */
+    u32 count = 0;
+    for(;;)
+    {
+        WheelTimer* timer = NULL;
+        {
+            MGuard guard( lock_ );
+            timer = expired_;
+            if( timer == NULL )
+                break;
+            unlink( timer );
+            interlockedAdd32( &armed_, -1 );
+            expiring_ = timer;
+            expiringThread_ = currentThreadId();
+        }
+
+        try {
+            timer->expired();
+        }
+        catch( ... ) {
+            expirationDone();
+            throw;
+        }
+        expirationDone();
+        ++count;
+    }
+    return count;
+}
+
+void TimingWheel::expirationDone()
+{
+    bool waiting;
+    {
+        MGuard guard( lock_ );
+        expiring_ = NULL;
+        waiting = (cancelWaiting_ != 0);
+    }
+    if( waiting )
+        expirationDone_->set();
+}
+
+/***********************************************************/
+void TimingWheel::run()
+{
+    while( interlockedLoad32(&running_) )
+    {
+        stop_->wait( tick_ );
+        if( !interlockedLoad32(&running_) )
+            break;
+        advance();
+    }
+}
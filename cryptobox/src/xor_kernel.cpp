@@ -0,0 +1,231 @@
+#include "xor_kernel.h"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    #define XOR_KERNEL_X86 1
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define XOR_TARGET(isa)
+    #else
+        #define XOR_TARGET(isa) __attribute__((target(isa)))
+    #endif
+#endif
+
+/***********************************************************/
+static void xorScalar( u8* dst, const u8* src, const u8* pad, u32 len )
+{
+    u32 i = 0;
+    for( ; i + 8 <= len; i += 8 )
+    {
+        u64 data, key;
+        memcpy( &data, src + i, 8 );
+        memcpy( &key, pad + i, 8 );
+        data ^= key;
+        memcpy( dst + i, &data, 8 );
+    }
+    for( ; i < len; ++i )
+        dst[i] = src[i] ^ pad[i];
+}
+
+#ifdef XOR_KERNEL_X86
+
+XOR_TARGET("sse2")
+static void xorSSE2( u8* dst, const u8* src, const u8* pad, u32 len )
+{
+    u32 i = 0;
+    for( ; i + 64 <= len; i += 64 )
+    {
+        __m128i d0 = _mm_loadu_si128( (const __m128i*)(src + i) );
+        __m128i d1 = _mm_loadu_si128( (const __m128i*)(src + i + 16) );
+        __m128i d2 = _mm_loadu_si128( (const __m128i*)(src + i + 32) );
+        __m128i d3 = _mm_loadu_si128( (const __m128i*)(src + i + 48) );
+        d0 = _mm_xor_si128( d0, _mm_loadu_si128((const __m128i*)(pad + i)) );
+        d1 = _mm_xor_si128( d1, _mm_loadu_si128((const __m128i*)(pad + i + 16)) );
+        d2 = _mm_xor_si128( d2, _mm_loadu_si128((const __m128i*)(pad + i + 32)) );
+        d3 = _mm_xor_si128( d3, _mm_loadu_si128((const __m128i*)(pad + i + 48)) );
+        _mm_storeu_si128( (__m128i*)(dst + i), d0 );
+        _mm_storeu_si128( (__m128i*)(dst + i + 16), d1 );
+        _mm_storeu_si128( (__m128i*)(dst + i + 32), d2 );
+        _mm_storeu_si128( (__m128i*)(dst + i + 48), d3 );
+    }
+    for( ; i + 16 <= len; i += 16 )
+    {
+        __m128i d = _mm_loadu_si128( (const __m128i*)(src + i) );
+        d = _mm_xor_si128( d, _mm_loadu_si128((const __m128i*)(pad + i)) );
+        _mm_storeu_si128( (__m128i*)(dst + i), d );
+    }
+    xorScalar( dst + i, src + i, pad + i, len - i );
+}
+
+XOR_TARGET("avx2")
+static void xorAVX2( u8* dst, const u8* src, const u8* pad, u32 len )
+{
+    u32 i = 0;
+    for( ; i + 128 <= len; i += 128 )
+    {
+        __m256i d0 = _mm256_loadu_si256( (const __m256i*)(src + i) );
+        __m256i d1 = _mm256_loadu_si256( (const __m256i*)(src + i + 32) );
+        __m256i d2 = _mm256_loadu_si256( (const __m256i*)(src + i + 64) );
+        __m256i d3 = _mm256_loadu_si256( (const __m256i*)(src + i + 96) );
+        d0 = _mm256_xor_si256( d0, _mm256_loadu_si256((const __m256i*)(pad + i)) );
+        d1 = _mm256_xor_si256( d1, _mm256_loadu_si256((const __m256i*)(pad + i + 32)) );
+        d2 = _mm256_xor_si256( d2, _mm256_loadu_si256((const __m256i*)(pad + i + 64)) );
+        d3 = _mm256_xor_si256( d3, _mm256_loadu_si256((const __m256i*)(pad + i + 96)) );
+        _mm256_storeu_si256( (__m256i*)(dst + i), d0 );
+        _mm256_storeu_si256( (__m256i*)(dst + i + 32), d1 );
+        _mm256_storeu_si256( (__m256i*)(dst + i + 64), d2 );
+        _mm256_storeu_si256( (__m256i*)(dst + i + 96), d3 );
+    }
+    for( ; i + 32 <= len; i += 32 )
+    {
+        __m256i d = _mm256_loadu_si256( (const __m256i*)(src + i) );
+        d = _mm256_xor_si256( d, _mm256_loadu_si256((const __m256i*)(pad + i)) );
+        _mm256_storeu_si256( (__m256i*)(dst + i), d );
+    }
+    xorScalar( dst + i, src + i, pad + i, len - i );
+}
+
+XOR_TARGET("avx512f")
+static void xorAVX512( u8* dst, const u8* src, const u8* pad, u32 len )
+{
+    u32 i = 0;
+    for( ; i + 256 <= len; i += 256 )
+    {
+        __m512i d0 = _mm512_loadu_si512( (const void*)(src + i) );
+        __m512i d1 = _mm512_loadu_si512( (const void*)(src + i + 64) );
+        __m512i d2 = _mm512_loadu_si512( (const void*)(src + i + 128) );
+        __m512i d3 = _mm512_loadu_si512( (const void*)(src + i + 192) );
+        d0 = _mm512_xor_si512( d0, _mm512_loadu_si512((const void*)(pad + i)) );
+        d1 = _mm512_xor_si512( d1, _mm512_loadu_si512((const void*)(pad + i + 64)) );
+        d2 = _mm512_xor_si512( d2, _mm512_loadu_si512((const void*)(pad + i + 128)) );
+        d3 = _mm512_xor_si512( d3, _mm512_loadu_si512((const void*)(pad + i + 192)) );
+        _mm512_storeu_si512( (void*)(dst + i), d0 );
+        _mm512_storeu_si512( (void*)(dst + i + 64), d1 );
+        _mm512_storeu_si512( (void*)(dst + i + 128), d2 );
+        _mm512_storeu_si512( (void*)(dst + i + 192), d3 );
+    }
+    for( ; i + 64 <= len; i += 64 )
+    {
+        __m512i d = _mm512_loadu_si512( (const void*)(src + i) );
+        d = _mm512_xor_si512( d, _mm512_loadu_si512((const void*)(pad + i)) );
+        _mm512_storeu_si512( (void*)(dst + i), d );
+    }
+    xorScalar( dst + i, src + i, pad + i, len - i );
+}
+
+/*  CPU and OS (saved register state) support of instruction set */
+static bool isSupported( XorKernel::Type type )
+{
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid( regs, 0 );
+    int maxLeaf = regs[0];
+
+    __cpuid( regs, 1 );
+    bool sse2 = (regs[3] & (1 << 26)) != 0;
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    u64 xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool ymm = (xcr0 & 0x06) == 0x06;
+    bool zmm = (xcr0 & 0xE6) == 0xE6;
+
+    int ebx7 = 0;
+    if( maxLeaf >= 7 ) {
+        __cpuidex( regs, 7, 0 );
+        ebx7 = regs[1];
+    }
+
+    switch( type )
+    {
+    case XorKernel::Scalar: return true;
+    case XorKernel::SSE2:   return sse2;
+    case XorKernel::AVX2:   return ymm && (ebx7 & (1 << 5)) != 0;
+    case XorKernel::AVX512: return zmm && (ebx7 & (1 << 16)) != 0;
+    default:                return false;
+    }
+#else
+    __builtin_cpu_init();
+    switch( type )
+    {
+    case XorKernel::Scalar: return true;
+    case XorKernel::SSE2:   return __builtin_cpu_supports("sse2") != 0;
+    case XorKernel::AVX2:   return __builtin_cpu_supports("avx2") != 0;
+    case XorKernel::AVX512: return __builtin_cpu_supports("avx512f") != 0;
+    default:                return false;
+    }
+#endif
+}
+
+#else /* XOR_KERNEL_X86 */
+
+static bool isSupported( XorKernel::Type type )
+{
+    return type == XorKernel::Scalar;
+}
+
+#endif /* XOR_KERNEL_X86 */
+
+/***********************************************************/
+XorKernel::Func volatile XorKernel::current_ = &XorKernel::dispatch;
+
+void XorKernel::dispatch( u8* dst, const u8* src, const u8* pad, u32 len )
+{
+    /*  racing threads detect the same kernel, so plain store is enough */
+    current_ = get( detect() );
+    current_( dst, src, pad, len );
+}
+
+XorKernel::Type XorKernel::detect( void )
+{
+    for( i32 type = TypesNum - 1; type > Scalar; --type ) {
+        if( isSupported((Type)type) )
+            return (Type)type;
+    }
+    return Scalar;
+}
+
+XorKernel::Func XorKernel::get( Type type )
+{
+    if( !isSupported(type) )
+        return NULL;
+
+    switch( type )
+    {
+#ifdef XOR_KERNEL_X86
+    case SSE2:   return &xorSSE2;
+    case AVX2:   return &xorAVX2;
+    case AVX512: return &xorAVX512;
+#endif
+    case Scalar: return &xorScalar;
+    default:     return NULL;
+    }
+}
+
+bool XorKernel::select( Type type )
+{
+    Func func = get( type );
+    if( func == NULL )
+        return false;
+    current_ = func;
+    return true;
+}
+
+XorKernel::Type XorKernel::selected( void )
+{
+    Func func = current_;
+    if( func == &dispatch )
+        func = get( detect() );
+
+    for( i32 type = Scalar; type < TypesNum; ++type ) {
+        if( get((Type)type) == func )
+            return (Type)type;
+    }
+    return Scalar;
+}
+
+const char* XorKernel::name( Type type )
+{
+    static const char* names[TypesNum] = { "scalar", "SSE2", "AVX2", "AVX-512" };
+    return (type < TypesNum) ? names[type] : "invalid";
+}
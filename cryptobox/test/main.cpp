@@ -73,5 +73,79 @@ int main()
     fflush(stdout);
     if( ret ) return ret;
 
+    printf("******************************************************************\n");
+    printf("5. NACK tracking of cluster gaps\n");
+    printf("__________________________________________________________________\n");
+    printf("Options: gap split by retransmit, image cluster boundary, retries limit,\n");
+    printf("         resync after repositioning and rewind\n");
+    printf("__________________________________________________________________\n");
+
+    ret = test_NackTracker();
+    printf( (ret == 0) ? "\t\t\tPASS!\n\n" : "\t\t\tFAIL!\n\n" );
+    fflush(stdout);
+    if( ret ) return ret;
+
+    printf("******************************************************************\n");
+    printf("6. FEC parity rebuilding of lost clusters\n");
+    printf("__________________________________________________________________\n");
+    printf("Options: groups of 4 clusters over image cluster boundaries,\n");
+    printf("         parity stripes in reverse order, late group member\n");
+    printf("__________________________________________________________________\n");
+
+    ret = test_FecCodec();
+    printf( (ret == 0) ? "\t\t\tPASS!\n\n" : "\t\t\tFAIL!\n\n" );
+    fflush(stdout);
+    if( ret ) return ret;
+
+    printf("******************************************************************\n");
+    printf("7. Duplicate filter of redundant clusters\n");
+    printf("__________________________________________________________________\n");
+    printf("Options: reordered copies, window sliding, stale ids and restart after jumps\n");
+    printf("Window      : 128 ids\n");
+    printf("__________________________________________________________________\n");
+
+    ret = test_DuplicateFilter();
+    printf( (ret == 0) ? "\t\t\tPASS!\n\n" : "\t\t\tFAIL!\n\n" );
+    fflush(stdout);
+    if( ret ) return ret;
+
+    printf("******************************************************************\n");
+    printf("8. Timing wheel deadlines\n");
+    printf("__________________________________________________________________\n");
+    printf("Options: cancelling, cascading over levels, re-arming from expiration,\n");
+    printf("         cancelling waits for running expiration\n");
+    printf("__________________________________________________________________\n");
+
+    ret = test_TimingWheel();
+    printf( (ret == 0) ? "\t\t\tPASS!\n\n" : "\t\t\tFAIL!\n\n" );
+    fflush(stdout);
+    if( ret ) return ret;
+
+    printf("******************************************************************\n");
+    printf("9. Page delivery policy\n");
+    printf("__________________________________________________________________\n");
+    printf("Options: idle link, dense traffic, queued packages, latency limit\n");
+    printf("         of configuration loaded after construction\n");
+    printf("__________________________________________________________________\n");
+
+    ret = test_PageCoalescer();
+    printf( (ret == 0) ? "\t\t\tPASS!\n\n" : "\t\t\tFAIL!\n\n" );
+    fflush(stdout);
+    if( ret ) return ret;
+
+    printf("******************************************************************\n");
+    printf("10. Async EnqueBufferSender over SPSC rings\n");
+    printf("__________________________________________________________________\n");
+    printf("Options: lock-free ring buffers, ring is smaller than messages amount\n");
+    printf("Iterations:   30 000 messages\n");
+    printf("Buffers size: 1 Mb\n");
+    printf("Ring slots:   1024 messages\n");
+    printf("Message size: 50 bytes\n");
+    printf("__________________________________________________________________\n");
+
+    ret = test_RingBufferSender(30000, 1000, 1024, &notifier);
+    printf( (ret == 0) ? "\r\n\t\t\tPASS!\n\n" : "\r\n\t\t\tFAIL!\n\n" );
+    if( ret ) return ret;
+
     return 0;
 }
@@ -38,13 +38,23 @@ SOURCES += \
     ../src/aes_base.cpp \
     ../src/aes_key_exchange.cpp \
     ../src/aes_package.cpp \
+    ../src/channel_scheduler.cpp \
     ../src/enque_buffer_sender.cpp \
     ../src/gap_detector.cpp \
     ../src/otp_base.cpp \
     ../src/otp_package.cpp \
+    ../src/packet_pool.cpp \
+    ../src/page_coalescer.cpp \
     ../src/raw_message.cpp \
+    ../src/retransmit_link.cpp \
+    ../src/ring_fifo_buffer.cpp \
     ../src/ssl_tunnel.cpp \
+    ../src/timing_wheel.cpp \
+    ../src/xor_kernel.cpp \
     ./main.cpp \
     ./test_classes.cpp \
     ./test_enque_buffer_sender.cpp \
-    ./test_otp.cpp
+    ./test_otp.cpp \
+    ./test_page_coalescer.cpp \
+    ./test_retransmit_link.cpp \
+    ./test_timing_wheel.cpp
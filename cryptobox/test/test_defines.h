@@ -21,6 +21,12 @@ class NotificationsMgrBase;
 
 int test_EnqueBufferSender(u32 nMessages, u32 kbBufferSize, u32 nMessageSize, NotificationsMgrBase* pNotifier);
 int test_OTP(u32 nMessages, u32 otp_size_mb, u32 nMessageSize, NotificationsMgrBase* pNotifier);
+int test_NackTracker();
+int test_FecCodec();
+int test_DuplicateFilter();
+int test_TimingWheel();
+int test_PageCoalescer();
+int test_RingBufferSender(u32 nMessages, u32 kbBufferSize, u32 ringSlots, NotificationsMgrBase* pNotifier);
 
 
 
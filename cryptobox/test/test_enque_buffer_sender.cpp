@@ -6,10 +6,12 @@ const char szTestMsgText[] = "Simple;*Test%$#Message!@#With*&^Text*)(*&Random+_)
 static RawMessage g_enq_test_msg( (const u8*)szTestMsgText, sizeof(szTestMsgText));
 
 /***********************************************************/
-int test_EnqueBufferSender(u32 nMessages, 
-                           u32 kbBufferSize, 
-                           u32 nMessageSize,
-                           NotificationsMgrBase* pNotifier)
+/*  Pipeline of test modules, ringSlots switches their buffers to SPSC rings */
+static int runEnqueBufferSender(u32 nMessages, 
+                                u32 kbBufferSize, 
+                                u32 nMessageSize,
+                                NotificationsMgrBase* pNotifier,
+                                u32 ringSlots)
 {
     try {
         if( nMessageSize ) {
@@ -35,6 +37,20 @@ int test_EnqueBufferSender(u32 nMessages,
         tunnel.setInBufferSize(kbBufferSize);
         tunnel.setOutBufferSize(kbBufferSize);
 
+        if( ringSlots ) {
+            /*  each buffer has one producer stage and one consumer thread */
+            if( !gateway.setInRingMode(ringSlots) || !gateway.setOutRingMode(ringSlots) ||
+                !aes.setInRingMode(ringSlots) || !aes.setOutRingMode(ringSlots) ||
+                !otp.setInRingMode(ringSlots) || !otp.setOutRingMode(ringSlots) ||
+                !tunnel.setInRingMode(ringSlots) || !tunnel.setOutRingMode(ringSlots) )
+            {
+                printf("Can't switch buffers to ring mode\n");
+                return -1;
+            }
+            /*  bulk stage drains to the half before its producer is released */
+            otp.setInLowWatermark(50);
+        }
+
         start.attach( &gateway, true );
         start.attach( &gateway, false );
         gateway.attach( &start, true );
@@ -114,3 +130,21 @@ int test_EnqueBufferSender(u32 nMessages,
     }
     return 0;
 }
+
+/***********************************************************/
+int test_EnqueBufferSender(u32 nMessages, 
+                           u32 kbBufferSize, 
+                           u32 nMessageSize,
+                           NotificationsMgrBase* pNotifier)
+{
+    return runEnqueBufferSender(nMessages, kbBufferSize, nMessageSize, pNotifier, 0);
+}
+
+/***********************************************************/
+int test_RingBufferSender(u32 nMessages, 
+                          u32 kbBufferSize, 
+                          u32 ringSlots,
+                          NotificationsMgrBase* pNotifier)
+{
+    return runEnqueBufferSender(nMessages, kbBufferSize, 0, pNotifier, ringSlots);
+}
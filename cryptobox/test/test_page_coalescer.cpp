@@ -0,0 +1,133 @@
+#include "test_defines.h"
+#include "page_coalescer.h"
+#include "configuration.h"
+
+#define PAGE_TEST_LIMIT         80          /* ms */
+#define PAGE_TEST_SHORT_LIMIT   10          /* ms */
+#define PAGE_TEST_START         1000000     /* us */
+#define PAGE_TEST_PACKAGE       1400
+#define PAGE_TEST_SMALL         64
+#define PAGE_TEST_DENSE_GAP     50          /* us */
+#define PAGE_TEST_SPARSE_GAP    1000        /* us */
+
+/***********************************************************/
+/*  Dense traffic of packages, the page is delivered when it is filled or delay is 0 */
+static void denseTraffic( PageCoalescer* coalescer, u64* now, u32 packages )
+{
+    u32 fill = 0;
+    for( u32 i = 0; i < packages; ++i )
+    {
+        *now += PAGE_TEST_DENSE_GAP;
+        fill = (fill + PAGE_TEST_PACKAGE > CLUSTER_DATALEN) ? PAGE_TEST_PACKAGE : fill + PAGE_TEST_PACKAGE;
+        u32 delay = coalescer->onPackage( PAGE_TEST_PACKAGE, fill, 0, *now );
+        if( delay == 0 ) {
+            coalescer->onDelivered();
+            fill = 0;
+        }
+    }
+}
+
+/***********************************************************/
+int test_PageCoalescer()
+{
+    u32 savedLimit = GV_OtpPageDeliveryTimelimit;
+
+    try {
+        printf("Idle link ...\n");
+        {
+            PageCoalescer coalescer( PAGE_TEST_LIMIT );
+            u64 now = PAGE_TEST_START;
+            if( coalescer.onPackage(PAGE_TEST_SMALL, PAGE_TEST_SMALL, 0, now) != 0 )
+                throw Exception("the first package of idle link is delayed");
+
+            now += PAGE_TEST_LIMIT * PAGE_IDLE_FACTOR * 1000;
+            if( coalescer.onPackage(PAGE_TEST_SMALL, PAGE_TEST_SMALL, 0, now) != 0 )
+                throw Exception("package after the long pause is delayed");
+        }
+        printf("OK\n");
+
+        printf("Dense traffic ...\n");
+        {
+            PageCoalescer coalescer( PAGE_TEST_LIMIT );
+            u64 now = PAGE_TEST_START;
+            denseTraffic( &coalescer, &now, 100 );
+
+            /*  not filled page waits for the next packages about mean gap */
+            now += PAGE_TEST_DENSE_GAP;
+            u32 delay = coalescer.onPackage( PAGE_TEST_PACKAGE, PAGE_TEST_PACKAGE, 0, now );
+            if( delay == 0 || delay > 1 )
+                throw Exception("not filled page of dense traffic isn't coalesced for a while");
+            now += PAGE_TEST_DENSE_GAP;
+            if( coalescer.onPackage(PAGE_TEST_PACKAGE, CLUSTER_DATALEN, 0, now) != 0 )
+                throw Exception("filled page isn't delivered");
+        }
+        printf("OK\n");
+
+        printf("Latency limit ...\n");
+        {
+            /*  small packages can't fill the page in time, it's held till the limit */
+            PageCoalescer coalescer( PAGE_TEST_LIMIT );
+            u64 now = PAGE_TEST_START;
+            u64 started = 0;
+            u32 fill = 0;
+            for( u32 i = 0; i < 1000; ++i )
+            {
+                now += PAGE_TEST_SPARSE_GAP;
+                fill += PAGE_TEST_SMALL;
+                u32 delay = coalescer.onPackage( PAGE_TEST_SMALL, fill, 0, now );
+                if( fill == PAGE_TEST_SMALL )
+                    started = now;
+                if( now + (u64)delay * 1000 > started + (PAGE_TEST_LIMIT + 1) * 1000 )
+                    throw Exception("page is held longer than latency limit");
+                if( delay == 0 ) {
+                    coalescer.onDelivered();
+                    fill = 0;
+                }
+            }
+        }
+        printf("OK\n");
+
+        printf("Queued packages ...\n");
+        {
+            PageCoalescer coalescer( PAGE_TEST_LIMIT );
+            u64 now = PAGE_TEST_START;
+            denseTraffic( &coalescer, &now, 100 );
+            now += PAGE_TEST_DENSE_GAP;
+            if( coalescer.onPackage(PAGE_TEST_PACKAGE, PAGE_TEST_PACKAGE, 5, now) != PAGE_QUEUED_DELAY )
+                throw Exception("page with queued packages is held longer than they are added");
+        }
+        printf("OK\n");
+
+        printf("Latency limit of configuration ...\n");
+        {
+            /*  the limit is read at use time, after configuration loading,
+                queued packages hold the page till the limit */
+            GV_OtpPageDeliveryTimelimit = PAGE_TEST_LIMIT;
+            PageCoalescer coalescer;
+            GV_OtpPageDeliveryTimelimit = PAGE_TEST_SHORT_LIMIT;
+
+            u64 now = PAGE_TEST_START;
+            denseTraffic( &coalescer, &now, 100 );
+            coalescer.onDelivered();
+            u64 started = now + PAGE_TEST_SPARSE_GAP;
+            u32 fill = 0;
+            for( u32 i = 0; i < PAGE_TEST_LIMIT; ++i ) {
+                now += PAGE_TEST_SPARSE_GAP;
+                fill += PAGE_TEST_SMALL;
+                if( coalescer.onPackage(PAGE_TEST_SMALL, fill, 1, now) == 0 )
+                    break;
+            }
+            if( now - started != PAGE_TEST_SHORT_LIMIT * 1000 )
+                throw Exception("page is held by the limit of construction time");
+        }
+        GV_OtpPageDeliveryTimelimit = savedLimit;
+        printf("OK\n");
+    }
+    catch( const Exception& ex ) {
+        GV_OtpPageDeliveryTimelimit = savedLimit;
+        printf("Exception: %s\n", ex.what() );
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,343 @@
+#include "test_defines.h"
+#include "retransmit_link.h"
+
+#define NACK_TEST_START     1000000     /* us */
+#define FEC_TEST_GROUP      4
+#define FEC_TEST_FRAMES     (FEC_TEST_GROUP * 4)
+#define DUP_TEST_WINDOW     128
+#define DUP_TEST_START      1000
+
+/***********************************************************/
+static bool checkRanges( const char* step, const ClusterIdRangesT& ranges,
+                         const ClusterIdRange* expected, u32 expectedNum )
+{
+    bool ok = (ranges.size() == expectedNum);
+    for( u32 i = 0; ok && i < expectedNum; ++i )
+        ok = (ranges[i].from == expected[i].from && ranges[i].to == expected[i].to);
+    if( !ok )
+    {
+        printf("%s: %u ranges are NACKed, %u expected\n", step, (u32)ranges.size(), expectedNum);
+        for( size_t i = 0; i < ranges.size(); ++i )
+            printf("  [%llX, %llX)\n", (unsigned long long)ranges[i].from, (unsigned long long)ranges[i].to);
+    }
+    return ok;
+}
+
+/***********************************************************/
+int test_NackTracker()
+{
+    NackTracker tracker;
+    ClusterIdRangesT ranges;
+    u64 now = NACK_TEST_START;
+
+    const u64 first = Cluster::makeClusterIdFromNum( 10 );
+    const u64 second = Cluster::makeClusterIdFromNum( 11 );
+
+    printf("Gap inside image cluster ...\n");
+    tracker.onCluster( first, false, now );
+    tracker.onCluster( first + 1, true, now );
+    tracker.onCluster( second, false, now );
+    tracker.onCluster( second + 4, false, now );
+
+    /*  reordering delay is given to the other channel */
+    u64 due = tracker.collect( now, &ranges );
+    if( !ranges.empty() || due != now + DEF_NACK_REORDER_DELAY * 1000 ) {
+        printf("Gap is NACKed before reordering delay\n");
+        return -1;
+    }
+
+    now = due;
+    ClusterIdRange gap = { second + 1, second + 4 };
+    tracker.collect( now, &ranges );
+    if( !checkRanges("First NACK", ranges, &gap, 1) )
+        return -1;
+    printf("OK\n");
+
+    printf("Gap split by retransmitted cluster ...\n");
+    now += 500;
+    if( !tracker.onCluster(second + 2, false, now) || tracker.onCluster(second + 2, false, now) ) {
+        printf("Retransmitted cluster isn't accepted once\n");
+        return -1;
+    }
+    if( tracker.getRtt() != 500 ) {
+        printf("RTT %llu us, 500 us expected\n", (unsigned long long)tracker.getRtt());
+        return -1;
+    }
+
+    /*  both parts keep the retry time of the NACKed gap */
+    ranges.clear();
+    tracker.collect( now, &ranges );
+    if( !ranges.empty() ) {
+        printf("Split gap is NACKed before retry interval\n");
+        return -1;
+    }
+    now = tracker.nextDue();
+    ClusterIdRange parts[] = { { second + 1, second + 2 }, { second + 3, second + 4 } };
+    tracker.collect( now, &ranges );
+    if( !checkRanges("Retry of split gap", ranges, parts, 2) )
+        return -1;
+
+    tracker.onCluster( second + 1, false, now );
+    tracker.onCluster( second + 3, false, now );
+    if( tracker.nextDue() != 0 ) {
+        printf("Recovered gap is still tracked\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    printf("Gap over image cluster boundary ...\n");
+    const u64 fourth = Cluster::makeClusterIdFromNum( 13 );
+    tracker.onCluster( second + 5, true, now );
+    tracker.onCluster( fourth + 1, false, now );
+    ranges.clear();
+    now += DEF_NACK_REORDER_DELAY * 1000;
+    tracker.collect( now, &ranges );
+    ClusterIdRange boundary = { Cluster::makeClusterIdFromNum(12), fourth + 1 };
+    if( !checkRanges("Boundary gap", ranges, &boundary, 1) )
+        return -1;
+
+    /*  the gap is given up after the last NACK */
+    for( u32 i = 1; i < DEF_NACK_RETRIES; ++i ) {
+        now = tracker.nextDue();
+        tracker.collect( now, &ranges );
+    }
+    if( ranges.size() != DEF_NACK_RETRIES ) {
+        printf("%u NACKs are sent, %u expected\n", (u32)ranges.size(), (u32)DEF_NACK_RETRIES);
+        return -1;
+    }
+    now = tracker.nextDue();
+    ranges.clear();
+    if( tracker.collect(now, &ranges) != 0 || !ranges.empty() ) {
+        printf("Gap is NACKed after %u retries\n", (u32)DEF_NACK_RETRIES);
+        return -1;
+    }
+    printf("OK\n");
+
+    printf("Resync after peer repositioning and image rewind ...\n");
+    const u64 far = Cluster::makeClusterIdFromNum( 14 + DEF_REORDER_WINDOW );
+    tracker.onCluster( fourth + 3, false, now );
+    if( tracker.nextDue() == 0 ) {
+        printf("Gap isn't tracked\n");
+        return -1;
+    }
+    tracker.onCluster( far, false, now );
+    if( tracker.nextDue() != 0 ) {
+        printf("Gaps are kept after repositioning\n");
+        return -1;
+    }
+
+    tracker.onCluster( far + 2, false, now );
+    if( !tracker.onCluster(first, false, now) || tracker.nextDue() != 0 ) {
+        printf("Rewound cluster isn't accepted as the new start\n");
+        return -1;
+    }
+    tracker.onCluster( first + 2, false, now );
+    ranges.clear();
+    tracker.collect( now + DEF_NACK_REORDER_DELAY * 1000, &ranges );
+    ClusterIdRange rewound = { first + 1, first + 2 };
+    if( !checkRanges("Gap after rewind", ranges, &rewound, 1) )
+        return -1;
+    printf("OK\n");
+
+    return 0;
+}
+
+/***********************************************************/
+/*  Frame of data cluster with the content defined by id */
+static u32 makeTestFrame( u8* frame, u64 id, bool endOfCluster, u32 used )
+{
+    *(u64*)frame = id;
+    *(u16*)(frame + OTP_CHUNKID_OFFSET) = (u16)(id & 0x7FFF) | (endOfCluster ? Cluster::EndOfCluster : 0);
+    *(u32*)(frame + OTP_USEDLEN_OFFSET) = used;
+    for( u32 i = 0; i < used; ++i )
+        frame[OTP_HEADER_LEN + i] = (u8)(id * 31 + i);
+    return OTP_HEADER_LEN + used;
+}
+
+/*  Passes parity frames to decoder from the last stripe to the first one */
+static void passParity( FecDecoder& decoder, const std::vector<u8>& parity, std::vector<u8>* rebuilt )
+{
+    std::vector<u32> offsets;
+    for( u32 pos = 0; pos < parity.size(); pos += OTP_HEADER_LEN + *(const u32*)(&parity[pos] + OTP_USEDLEN_OFFSET) )
+        offsets.push_back( pos );
+
+    for( size_t i = offsets.size(); i > 0; --i ) {
+        const u8* frame = &parity[offsets[i - 1]];
+        decoder.onParity( frame + OTP_HEADER_LEN, *(const u32*)(frame + OTP_USEDLEN_OFFSET), rebuilt );
+    }
+}
+
+/***********************************************************/
+int test_FecCodec()
+{
+    /*  groups cross image cluster boundaries: 3 network clusters per image cluster,
+        full clusters need 2 parity stripes, the short ones need one */
+    static u8 frames[FEC_TEST_FRAMES][OTP_HEADER_LEN + CLUSTER_DATALEN];
+    u32 lens[FEC_TEST_FRAMES];
+    for( u32 i = 0; i < FEC_TEST_FRAMES; ++i ) {
+        u64 id = Cluster::makeClusterIdFromNum( 20 + i / 3 ) + i % 3;
+        u32 used = (i % 2) ? CLUSTER_DATALEN : 100 + i * 150;
+        lens[i] = makeTestFrame( frames[i], id, (i % 3) == 2, used );
+    }
+
+    FecEncoder encoder( FEC_TEST_GROUP );
+    FecDecoder decoder;
+    std::vector<u8> parity;
+    std::vector<u8> rebuilt;
+
+    printf("Parity of groups ...\n");
+    std::vector<u8> groups[FEC_TEST_FRAMES / FEC_TEST_GROUP];
+    for( u32 i = 0; i < FEC_TEST_FRAMES; ++i )
+    {
+        u32 stripes = encoder.add( frames[i], lens[i], &groups[i / FEC_TEST_GROUP] );
+        if( (i % FEC_TEST_GROUP != FEC_TEST_GROUP - 1 && stripes != 0) ||
+            (i % FEC_TEST_GROUP == FEC_TEST_GROUP - 1 && stripes != CLUSTER_DATALEN / FEC_STRIPE_SIZE) )
+        {
+            printf("%u parity frames after cluster %u\n", stripes, i);
+            return -1;
+        }
+    }
+    printf("OK\n");
+
+    printf("History starts from the first parity ...\n");
+    for( u32 i = 0; i < FEC_TEST_GROUP; ++i )
+        decoder.onData( *(const u64*)frames[i], frames[i], lens[i], &rebuilt );
+    if( decoder.isActive() ) {
+        printf("Decoder is active without parity\n");
+        return -1;
+    }
+    passParity( decoder, groups[0], &rebuilt );
+    if( !decoder.isActive() || !rebuilt.empty() ) {
+        printf("Group without history is rebuilt\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    printf("Full cluster rebuilt by stripes ...\n");
+    const u32 lost = FEC_TEST_GROUP + 1;
+    for( u32 i = FEC_TEST_GROUP; i < 2 * FEC_TEST_GROUP; ++i ) {
+        if( i != lost )
+            decoder.onData( *(const u64*)frames[i], frames[i], lens[i], &rebuilt );
+    }
+    passParity( decoder, groups[1], &rebuilt );
+    if( decoder.getRebuilt() != 1 || rebuilt.size() != lens[lost] ||
+        memcmp(&rebuilt[0], frames[lost], lens[lost]) != 0 )
+    {
+        printf("Cluster %u isn't rebuilt\n", lost);
+        return -1;
+    }
+    printf("OK\n");
+
+    printf("Cluster rebuilt by the late member ...\n");
+    rebuilt.clear();
+    const u32 late = 2 * FEC_TEST_GROUP;
+    const u32 missed = 2 * FEC_TEST_GROUP + 2;
+    for( u32 i = 2 * FEC_TEST_GROUP; i < 3 * FEC_TEST_GROUP; ++i ) {
+        if( i != late && i != missed )
+            decoder.onData( *(const u64*)frames[i], frames[i], lens[i], &rebuilt );
+    }
+    passParity( decoder, groups[2], &rebuilt );
+    if( !rebuilt.empty() ) {
+        printf("Group with two missed clusters is rebuilt\n");
+        return -1;
+    }
+    decoder.onData( *(const u64*)frames[late], frames[late], lens[late], &rebuilt );
+    if( decoder.getRebuilt() != 2 || rebuilt.size() != lens[missed] ||
+        memcmp(&rebuilt[0], frames[missed], lens[missed]) != 0 )
+    {
+        printf("Cluster %u isn't rebuilt\n", missed);
+        return -1;
+    }
+    printf("OK\n");
+
+    printf("Nothing rebuilt for the complete group ...\n");
+    rebuilt.clear();
+    for( u32 i = 3 * FEC_TEST_GROUP; i < FEC_TEST_FRAMES; ++i )
+        decoder.onData( *(const u64*)frames[i], frames[i], lens[i], &rebuilt );
+    passParity( decoder, groups[3], &rebuilt );
+    if( !rebuilt.empty() || decoder.getRebuilt() != 2 ) {
+        printf("Complete group is rebuilt\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    return 0;
+}
+
+/***********************************************************/
+int test_DuplicateFilter()
+{
+    DuplicateFilter filter( DUP_TEST_WINDOW );
+
+    printf("Duplicates rejection ...\n");
+    if( !filter.check(DUP_TEST_START) || filter.check(DUP_TEST_START) ) {
+        printf("The first id isn't accepted once\n");
+        return -1;
+    }
+    /*  the copy from the slower channel comes after the newer id */
+    if( !filter.check(DUP_TEST_START + 2) || !filter.check(DUP_TEST_START + 1) ||
+        filter.check(DUP_TEST_START + 1) || filter.check(DUP_TEST_START + 2) )
+    {
+        printf("Reordered ids aren't accepted once\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    printf("Window sliding ...\n");
+    for( u64 id = DUP_TEST_START + 3; id < DUP_TEST_START + DUP_TEST_WINDOW; ++id ) {
+        if( !filter.check(id) ) {
+            printf("New id %llu is rejected\n", (unsigned long long)id);
+            return -1;
+        }
+    }
+    /*  slot of the oldest id is reused by the newest one, the rest of window is kept */
+    if( !filter.check(DUP_TEST_START + DUP_TEST_WINDOW) || filter.check(DUP_TEST_START + 2) ) {
+        printf("Window isn't slid by one id\n");
+        return -1;
+    }
+    /*  slots of the skipped ids are cleared */
+    const u64 top = DUP_TEST_START + DUP_TEST_WINDOW + DUP_TEST_WINDOW / 2;
+    if( !filter.check(top) || !filter.check(top - 1) || !filter.check(top - DUP_TEST_WINDOW / 2 + 1) ||
+        filter.check(top - DUP_TEST_WINDOW + 2) )
+    {
+        printf("Window isn't slid by a gap\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    printf("Stale ids ...\n");
+    /*  the late copy behind the window neither passes nor wipes the window */
+    if( filter.check(top - DUP_TEST_WINDOW) || filter.check(DUP_TEST_START + 1) ||
+        filter.check(top) || filter.check(top - 1) )
+    {
+        printf("Stale id isn't rejected\n");
+        return -1;
+    }
+    if( filter.behind(top - DUP_TEST_WINDOW) != DUP_TEST_WINDOW || filter.behind(top + 1) != 0 ) {
+        printf("Invalid distance behind the window\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    printf("Window restart after jumps ...\n");
+    const u64 jump = top + 0x100000;
+    if( !filter.check(jump) || filter.check(jump) || !filter.check(jump - 1) ) {
+        printf("Window isn't restarted by repositioning\n");
+        return -1;
+    }
+    /*  the image rewind repeats ids seen before the jump after reset */
+    if( filter.check(DUP_TEST_START + 1) ) {
+        printf("Id before the jump isn't rejected as stale\n");
+        return -1;
+    }
+    filter.reset();
+    if( !filter.check(DUP_TEST_START + 1) || filter.check(DUP_TEST_START + 1) ||
+        !filter.check(DUP_TEST_START + 2) )
+    {
+        printf("Window isn't restarted by reset\n");
+        return -1;
+    }
+    printf("OK\n");
+
+    return 0;
+}
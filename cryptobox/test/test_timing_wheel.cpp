@@ -0,0 +1,186 @@
+#include "test_defines.h"
+#include "timing_wheel.h"
+
+#define WHEEL_TEST_TICK         1       /* ms */
+#define WHEEL_TEST_DELAY        20      /* ms */
+#define WHEEL_TEST_CASCADE      300     /* ms, level 1 of 1 ms wheel */
+#define WHEEL_TEST_FAR          70000   /* ms, level 2 of 1 ms wheel */
+#define WHEEL_TEST_REARMS       3
+#define WHEEL_TEST_EXPIRATION   100     /* ms of slow expiration */
+#define WHEEL_TEST_TIMEOUT      2000    /* ms */
+
+/***********************************************************/
+/*  Counts expirations, can re-arm or cancel itself and be slow */
+class TestTimer : public WheelTimer
+{
+public:
+    explicit TestTimer( TimingWheel* wheel )
+        : wheel_(wheel),
+        rearms_(0),
+        selfCancel_(false),
+        slow_(false),
+        started_(0),
+        expired_(0),
+        expiredUs_(0)
+    {}
+
+    virtual ~TestTimer()
+    { wheel_->cancel( this ); }
+
+    inline void setRearms( u32 rearms )
+    { rearms_ = rearms; }
+
+    inline void setSelfCancel( void )
+    { selfCancel_ = true; }
+
+    inline void setSlow( void )
+    { slow_ = true; }
+
+    inline u32 getStarted( void ) const
+    { return interlockedLoad32(&started_); }
+
+    inline u32 getExpired( void ) const
+    { return interlockedLoad32(&expired_); }
+
+    inline u64 getExpiredUs( void ) const
+    { return expiredUs_; }
+
+protected:
+    virtual void expired( void )
+    {
+        interlockedAdd32( &started_, 1 );
+        if( slow_ )
+            Thread::sleep( WHEEL_TEST_EXPIRATION );
+        if( rearms_ ) {
+            --rearms_;
+            wheel_->arm( this, WHEEL_TEST_TICK );
+        }
+        else if( selfCancel_ && wheel_->cancel(this) )
+            printf("Self cancelling of expired timer disarms it\n");
+
+        expiredUs_ = TimingWheel::monotonicUs();
+        interlockedAdd32( &expired_, 1 );
+    }
+
+private:
+    TimingWheel* wheel_;
+    u32 rearms_;
+    bool selfCancel_;
+    bool slow_;
+    volatile u32 started_;
+    volatile u32 expired_;
+    u64 expiredUs_;
+};
+
+/*  Advances the not started wheel till timer is expired or timeout,
+    deadlines are in whole ticks, so expiration can be a tick earlier than delay */
+static bool advanceTill( TimingWheel* wheel, const TestTimer& timer, u32 expired )
+{
+    u64 till = TimingWheel::monotonicUs() + WHEEL_TEST_TIMEOUT * 1000;
+    while( timer.getExpired() < expired && TimingWheel::monotonicUs() < till ) {
+        Thread::sleep( WHEEL_TEST_TICK );
+        wheel->advance();
+    }
+    return timer.getExpired() >= expired;
+}
+
+/*  Waits for expirations started by the wheel thread */
+static bool waitStarted( const TestTimer& timer, u32 started )
+{
+    u64 till = TimingWheel::monotonicUs() + WHEEL_TEST_TIMEOUT * 1000;
+    while( timer.getStarted() < started && TimingWheel::monotonicUs() < till )
+        Thread::sleep( WHEEL_TEST_TICK );
+    return timer.getStarted() >= started;
+}
+
+/***********************************************************/
+int test_TimingWheel()
+{
+    try {
+        printf("Arming and cancelling ...\n");
+        {
+            TimingWheel wheel( "testwheel", WHEEL_TEST_TICK );
+            TestTimer first( &wheel ), second( &wheel ), moved( &wheel );
+            u64 armed = TimingWheel::monotonicUs();
+            wheel.arm( &first, WHEEL_TEST_DELAY );
+            wheel.arm( &second, WHEEL_TEST_DELAY );
+            wheel.arm( &moved, WHEEL_TEST_DELAY );
+            wheel.arm( &moved, WHEEL_TEST_CASCADE );
+            if( wheel.getArmed() != 3 || !second.isArmed() )
+                throw Exception("timers aren't armed");
+            if( !wheel.cancel(&second) || wheel.cancel(&second) || second.isArmed() )
+                throw Exception("armed timer isn't cancelled once");
+
+            if( !advanceTill(&wheel, first, 1) )
+                throw Exception("timer isn't expired");
+            if( first.getExpiredUs() < armed + (WHEEL_TEST_DELAY - WHEEL_TEST_TICK) * 1000 )
+                throw Exception("timer is expired before deadline");
+            if( second.getExpired() || moved.getExpired() || !moved.isArmed() )
+                throw Exception("cancelled or re-armed timer is expired by the first deadline");
+            if( first.isArmed() || wheel.cancel(&first) || wheel.getArmed() != 1 )
+                throw Exception("expired timer is left armed");
+        }
+        printf("OK\n");
+
+        printf("Cascading over wheel levels ...\n");
+        {
+            TimingWheel wheel( "testwheel", WHEEL_TEST_TICK );
+            TestTimer near( &wheel ), far( &wheel );
+            u64 armed = TimingWheel::monotonicUs();
+            wheel.arm( &near, WHEEL_TEST_CASCADE );
+            wheel.arm( &far, WHEEL_TEST_FAR );
+
+            if( !advanceTill(&wheel, near, 1) )
+                throw Exception("timer of the second level isn't expired");
+            if( near.getExpiredUs() < armed + (WHEEL_TEST_CASCADE - WHEEL_TEST_TICK) * 1000 )
+                throw Exception("timer of the second level is expired before deadline");
+            if( far.getExpired() || !far.isArmed() || !wheel.cancel(&far) )
+                throw Exception("timer of the third level is expired by cascading");
+        }
+        printf("OK\n");
+
+        printf("Re-arming from expiration ...\n");
+        {
+            TimingWheel wheel( "testwheel", WHEEL_TEST_TICK );
+            TestTimer rearmed( &wheel ), cancelled( &wheel );
+            rearmed.setRearms( WHEEL_TEST_REARMS );
+            cancelled.setSelfCancel();
+            wheel.start();
+            wheel.arm( &rearmed, WHEEL_TEST_TICK );
+            wheel.arm( &cancelled, WHEEL_TEST_TICK );
+
+            if( !waitStarted(rearmed, WHEEL_TEST_REARMS + 1) || !waitStarted(cancelled, 1) )
+                throw Exception("re-armed timer isn't expired again");
+            Thread::sleep( WHEEL_TEST_DELAY );
+            wheel.shutdown();
+            if( rearmed.getExpired() != WHEEL_TEST_REARMS + 1 || cancelled.getExpired() != 1 ||
+                rearmed.isArmed() || wheel.getArmed() != 0 )
+                throw Exception("re-armed timer is expired more than armed");
+        }
+        printf("OK\n");
+
+        printf("Cancelling of running expiration ...\n");
+        {
+            TimingWheel wheel( "testwheel", WHEEL_TEST_TICK );
+            TestTimer slow( &wheel );
+            slow.setSlow();
+            wheel.start();
+            wheel.arm( &slow, WHEEL_TEST_TICK );
+
+            if( !waitStarted(slow, 1) )
+                throw Exception("timer isn't expired");
+            if( wheel.cancel(&slow) )
+                throw Exception("running timer is cancelled as armed");
+            if( slow.getExpired() != 1 )
+                throw Exception("cancelling doesn't wait for running expiration");
+            wheel.shutdown();
+        }
+        printf("OK\n");
+    }
+    catch( const Exception& ex ) {
+        printf("Exception: %s\n", ex.what() );
+        return -1;
+    }
+
+    return 0;
+}